@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dexgen.dex.file;
+
+import com.android.dexgen.dex.code.DalvCode;
+import com.android.dexgen.rop.code.AccessFlags;
+import com.android.dexgen.rop.code.BasicBlock;
+import com.android.dexgen.rop.code.BasicBlockList;
+import com.android.dexgen.rop.code.InsnList;
+import com.android.dexgen.rop.code.PlainInsn;
+import com.android.dexgen.rop.code.RegisterSpec;
+import com.android.dexgen.rop.code.RegisterSpecList;
+import com.android.dexgen.rop.code.RopMethod;
+import com.android.dexgen.rop.code.Rops;
+import com.android.dexgen.rop.code.SourcePosition;
+import com.android.dexgen.rop.code.ThrowingCstInsn;
+import com.android.dexgen.rop.cst.CstMethodRef;
+import com.android.dexgen.rop.cst.CstNat;
+import com.android.dexgen.rop.cst.CstString;
+import com.android.dexgen.rop.cst.CstType;
+import com.android.dexgen.rop.cst.CstUtf8;
+import com.android.dexgen.rop.type.StdTypeList;
+import com.android.dexgen.rop.type.Type;
+import com.android.dexgen.util.IntList;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.zip.Adler32;
+import junit.framework.TestCase;
+
+public final class DexBatchTest extends TestCase {
+    private static final int CONST_STRING = 0x1a;
+    private static final int CONST_STRING_JUMBO = 0x1b;
+
+    public void testMethodsSharingAShapeShareOneTranslation() throws Exception {
+        DexBatch batch = new DexBatch();
+        ConstStringShape shape = new ConstStringShape("shared");
+
+        DalvCode code = batch.getCode(shape);
+        batch.add(makeClass("LFirst;", code));
+        assertSame(code, batch.getCode(shape));
+        batch.add(makeClass("LSecond;", batch.getCode(shape)));
+        assertEquals(1, shape.buildCount);
+        assertEquals(2, batch.getClassCount());
+
+        Map<String, String> values = readValues(batch.flush());
+        assertEquals(2, values.size());
+        assertEquals("shared", values.get("LFirst;"));
+        assertEquals("shared", values.get("LSecond;"));
+    }
+
+    public void testFlushResetsTheCache() throws Exception {
+        DexBatch batch = new DexBatch();
+        ConstStringShape shape = new ConstStringShape("shared");
+
+        DalvCode first = batch.getCode(shape);
+        batch.add(makeClass("LFirst;", first));
+        batch.flush();
+        assertEquals(0, batch.getClassCount());
+
+        /*
+         * A file with more strings sorted before "shared" gives it another
+         * index, which the code of the previous file can't be used with.
+         */
+        DalvCode second = batch.getCode(shape);
+        assertNotSame(first, second);
+        assertEquals(2, shape.buildCount);
+        batch.add(makeClass("LAnother;", second));
+        batch.add(makeClass("LSecond;", second));
+
+        Map<String, String> values = readValues(batch.flush());
+        assertEquals(2, values.size());
+        assertEquals("shared", values.get("LAnother;"));
+        assertEquals("shared", values.get("LSecond;"));
+    }
+
+    public void testCodeOfAnEarlierFileIsRejected() throws Exception {
+        DexBatch batch = new DexBatch();
+        DalvCode code = batch.getCode(new ConstStringShape("shared"));
+        batch.add(makeClass("LFirst;", code));
+        batch.flush();
+
+        batch.add(makeClass("LSecond;", code));
+        try {
+            batch.flush();
+            fail();
+        } catch (IllegalStateException expected) {
+        }
+        assertEquals(0, batch.getClassCount());
+    }
+
+    /**
+     * Returns a public class with a static method {@code value()} of the
+     * given code.
+     */
+    private static ClassDefItem makeClass(String descriptor, DalvCode code) {
+        CstType type = CstType.intern(Type.intern(descriptor));
+        ClassDefItem result = new ClassDefItem(type, AccessFlags.ACC_PUBLIC,
+                CstType.OBJECT, StdTypeList.EMPTY, null);
+        CstMethodRef method = new CstMethodRef(type,
+                new CstNat(new CstUtf8("value"), new CstUtf8("()Ljava/lang/String;")));
+        result.addDirectMethod(new EncodedMethod(method,
+                AccessFlags.ACC_PUBLIC | AccessFlags.ACC_STATIC, code, StdTypeList.EMPTY));
+        return result;
+    }
+
+    /**
+     * Parses {@code dex} and returns, for each class, the string loaded by
+     * the first instruction of its only method.
+     */
+    private static Map<String, String> readValues(byte[] dex) {
+        ByteBuffer buffer = ByteBuffer.wrap(dex).order(ByteOrder.LITTLE_ENDIAN);
+        assertEquals("dex\n", new String(dex, 0, 4));
+        assertEquals(dex.length, buffer.getInt(0x20));
+        Adler32 adler = new Adler32();
+        adler.update(dex, 12, dex.length - 12);
+        assertEquals((int) adler.getValue(), buffer.getInt(8));
+
+        int methodIdsOff = buffer.getInt(0x5c);
+        int classDefsSize = buffer.getInt(0x60);
+        int classDefsOff = buffer.getInt(0x64);
+
+        Map<String, String> result = new HashMap<String, String>();
+        for (int i = 0; i < classDefsSize; i++) {
+            int classDef = classDefsOff + i * 32;
+            int classIdx = buffer.getInt(classDef);
+            buffer.position(buffer.getInt(classDef + 24));
+            assertEquals(0, readUleb128(buffer)); // static fields
+            assertEquals(0, readUleb128(buffer)); // instance fields
+            assertEquals(1, readUleb128(buffer)); // direct methods
+            assertEquals(0, readUleb128(buffer)); // virtual methods
+            int methodIdx = readUleb128(buffer);
+            readUleb128(buffer); // access flags
+            int codeOff = readUleb128(buffer);
+
+            int methodId = methodIdsOff + methodIdx * 8;
+            assertEquals(classIdx, buffer.getShort(methodId) & 0xffff);
+            assertEquals("value", readString(buffer, buffer.getInt(methodId + 4)));
+
+            int insns = codeOff + 16;
+            int opcode = buffer.get(insns) & 0xff;
+            int stringIdx;
+            if (opcode == CONST_STRING) {
+                stringIdx = buffer.getShort(insns + 2) & 0xffff;
+            } else {
+                assertEquals(CONST_STRING_JUMBO, opcode);
+                stringIdx = buffer.getInt(insns + 2);
+            }
+            result.put(typeName(buffer, classIdx), readString(buffer, stringIdx));
+        }
+        return result;
+    }
+
+    private static String typeName(ByteBuffer buffer, int typeIdx) {
+        int typeIdsOff = buffer.getInt(0x44);
+        return readString(buffer, buffer.getInt(typeIdsOff + typeIdx * 4));
+    }
+
+    /**
+     * Reads a string of the test, all of which are ASCII.
+     */
+    private static String readString(ByteBuffer buffer, int stringIdx) {
+        int stringIdsSize = buffer.getInt(0x38);
+        int stringIdsOff = buffer.getInt(0x3c);
+        assertTrue(stringIdx < stringIdsSize);
+        buffer.position(buffer.getInt(stringIdsOff + stringIdx * 4));
+        int length = readUleb128(buffer);
+        char[] chars = new char[length];
+        for (int i = 0; i < length; i++) {
+            chars[i] = (char) buffer.get();
+        }
+        assertEquals(0, buffer.get());
+        return new String(chars);
+    }
+
+    private static int readUleb128(ByteBuffer buffer) {
+        int result = 0;
+        int shift = 0;
+        int b;
+        do {
+            b = buffer.get() & 0xff;
+            result |= (b & 0x7f) << shift;
+            shift += 7;
+        } while ((b & 0x80) != 0);
+        return result;
+    }
+
+    /**
+     * The shape of {@code static String value() { return "..."; }}.
+     */
+    private static final class ConstStringShape extends DexBatch.MethodShape {
+        private final String value;
+        private int buildCount;
+
+        ConstStringShape(String value) {
+            this.value = value;
+        }
+
+        @Override
+        protected RopMethod buildRopMethod() {
+            buildCount++;
+            SourcePosition pos = SourcePosition.NO_INFO;
+            RegisterSpec result = RegisterSpec.make(0, Type.STRING);
+
+            InsnList load = new InsnList(1);
+            load.set(0, new ThrowingCstInsn(Rops.CONST_OBJECT, pos, RegisterSpecList.EMPTY,
+                    StdTypeList.EMPTY, new CstString(value)));
+            load.setImmutable();
+
+            InsnList ret = new InsnList(2);
+            ret.set(0, new PlainInsn(Rops.opMoveResultPseudo(Type.STRING), pos, result,
+                    RegisterSpecList.EMPTY));
+            ret.set(1, new PlainInsn(Rops.RETURN_OBJECT, pos, null,
+                    RegisterSpecList.make(result)));
+            ret.setImmutable();
+
+            BasicBlockList blocks = new BasicBlockList(2);
+            blocks.set(0, new BasicBlock(0, load, IntList.makeImmutable(1), 1));
+            blocks.set(1, new BasicBlock(1, ret, IntList.EMPTY, -1));
+            blocks.setImmutable();
+            return new RopMethod(blocks, 0);
+        }
+
+        @Override
+        protected int getParamSize() {
+            return 0;
+        }
+    }
+}
@@ -16,6 +16,7 @@
 
 package com.android.dexgen.dex.code;
 
+import com.android.dexgen.dex.file.DexFile;
 import com.android.dexgen.rop.cst.Constant;
 import com.android.dexgen.rop.type.Type;
 
@@ -68,6 +69,28 @@ public final class DalvCode {
      */
     private DalvInsnList insns;
 
+    /**
+     * {@code null-ok;} the file this instance is written to; set in
+     * {@link #setFile}
+     */
+    private DexFile file;
+
+    /**
+     * whether there is position info, local info and catches; saved in
+     * {@link #finishProcessingIfNecessary}, so that methods sharing this
+     * instance can still ask once the instructions are processed
+     */
+    private boolean hasPositions;
+    private boolean hasLocals;
+    private boolean hasAnyCatches;
+
+    /**
+     * {@code null-ok;} catch types and instruction constants; saved in
+     * {@link #finishProcessingIfNecessary}, like the flags above
+     */
+    private HashSet<Type> catchTypes;
+    private HashSet<Constant> insnConstants;
+
     /**
      * Constructs an instance.
      *
@@ -105,6 +128,12 @@ public final class DalvCode {
             return;
         }
 
+        hasPositions = hasPositions();
+        hasLocals = hasLocals();
+        hasAnyCatches = hasAnyCatches();
+        catchTypes = getCatchTypes();
+        insnConstants = getInsnConstants();
+
         insns = unprocessedInsns.finishProcessingAndGetList();
         positions = PositionList.make(insns, positionInfo);
         locals = LocalList.make(insns);
@@ -115,15 +144,41 @@ public final class DalvCode {
         unprocessedCatches = null;
     }
 
+    /**
+     * Records the file this instance is written to. An instance may be
+     * shared by several methods of one file, as
+     * {@link com.android.dexgen.dex.file.DexBatch} does, but not across
+     * files: its processed instructions depend on the indices of the file.
+     *
+     * @param file {@code non-null;} the file
+     * @throws IllegalStateException if this instance is already part of
+     * another file
+     */
+    public void setFile(DexFile file) {
+        if (file == null) {
+            throw new NullPointerException("file == null");
+        }
+
+        if ((this.file != null) && (this.file != file)) {
+            throw new IllegalStateException(
+                    "code already written to another file");
+        }
+
+        this.file = file;
+    }
+
     /**
      * Assign indices in all instructions that need them, using the
      * given callback to perform lookups. This must be called before
-     * {@link #getInsns}.
+     * {@link #getInsns}. Calls after the first one do nothing, since
+     * methods sharing this instance are all in one file.
      *
      * @param callback {@code non-null;} callback object
      */
     public void assignIndices(AssignIndicesCallback callback) {
-        unprocessedInsns.assignIndices(callback);
+        if (unprocessedInsns != null) {
+            unprocessedInsns.assignIndices(callback);
+        }
     }
 
     /**
@@ -133,6 +188,10 @@ public final class DalvCode {
      * data to represent
      */
     public boolean hasPositions() {
+        if (unprocessedInsns == null) {
+            return hasPositions;
+        }
+
         return (positionInfo != PositionList.NONE)
             && unprocessedInsns.hasAnyPositionInfo();
     }
@@ -144,6 +203,10 @@ public final class DalvCode {
      * data to represent
      */
     public boolean hasLocals() {
+        if (unprocessedInsns == null) {
+            return hasLocals;
+        }
+
         return unprocessedInsns.hasAnyLocalInfo();
     }
 
@@ -154,6 +217,10 @@ public final class DalvCode {
      * @return whether this instance has any catches at all
      */
     public boolean hasAnyCatches() {
+        if (unprocessedCatches == null) {
+            return hasAnyCatches;
+        }
+
         return unprocessedCatches.hasAnyCatches();
     }
 
@@ -163,6 +230,10 @@ public final class DalvCode {
      * @return {@code non-null;} the set of catch types
      */
     public HashSet<Type> getCatchTypes() {
+        if (unprocessedCatches == null) {
+            return catchTypes;
+        }
+
         return unprocessedCatches.getCatchTypes();
     }
 
@@ -173,6 +244,10 @@ public final class DalvCode {
      * @return {@code non-null;} the set of constants
      */
     public HashSet<Constant> getInsnConstants() {
+        if (unprocessedInsns == null) {
+            return insnConstants;
+        }
+
         return unprocessedInsns.getAllConstants();
     }
 
@@ -114,6 +114,8 @@ public final class CodeItem extends OffsettedItem {
 
     /** {@inheritDoc} */
     public void addContents(DexFile file) {
+        code.setFile(file);
+
         MixedItemSection byteData = file.getByteData();
         TypeIdsSection typeIds = file.getTypeIds();
 
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dexgen.dex.file;
+
+import com.android.dexgen.dex.code.DalvCode;
+import com.android.dexgen.dex.code.PositionList;
+import com.android.dexgen.dex.code.RopTranslator;
+import com.android.dexgen.rop.code.RopMethod;
+import com.android.dexgen.util.DexClassLoaderHelper;
+import com.android.dexgen.util.DexClassLoadingException;
+import com.android.dexgen.util.DexJarMaker;
+import com.android.dexgen.util.PathHolder;
+
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.util.HashMap;
+
+/**
+ * Collects generated classes into one dex file per {@link #flush}, for
+ * callers that generate many classes, e.g. mocks or proxies. Compared to
+ * one {@link DexFile} per class, the classes of a batch share the string,
+ * type, proto and member id tables of the file, and methods with the
+ * same {@link MethodShape} share one translation of their code.
+ *
+ * <p>This class is not thread safe.</p>
+ */
+public final class DexBatch {
+    /** {@code non-null;} file receiving the classes added since the last flush */
+    private DexFile file;
+
+    /** number of classes added since the last flush */
+    private int classCount;
+
+    /**
+     * {@code non-null;} translated code of each shape used since the last
+     * flush. Translated code is laid out for the indices of one file, so
+     * it can't outlive it.
+     */
+    private final HashMap<MethodShape, DalvCode> codes;
+
+    /**
+     * Constructs an empty instance.
+     */
+    public DexBatch() {
+        this.file = new DexFile();
+        this.classCount = 0;
+        this.codes = new HashMap<MethodShape, DalvCode>();
+    }
+
+    /**
+     * Adds a class to the current file.
+     *
+     * @param clazz {@code non-null;} the class to add
+     */
+    public void add(ClassDefItem clazz) {
+        if (clazz == null) {
+            throw new NullPointerException("clazz == null");
+        }
+
+        file.add(clazz);
+        classCount++;
+    }
+
+    /**
+     * Gets the number of classes added since the last flush.
+     *
+     * @return {@code >= 0;} the class count
+     */
+    public int getClassCount() {
+        return classCount;
+    }
+
+    /**
+     * Gets the code of a method of the given shape, translating it
+     * on the first use since the last flush. The result may only be used
+     * for methods of classes added to this instance before the next
+     * flush; writing it in a later file throws an
+     * {@code IllegalStateException}.
+     *
+     * @param shape {@code non-null;} the method shape
+     * @return {@code non-null;} the translated code
+     */
+    public DalvCode getCode(MethodShape shape) {
+        DalvCode result = codes.get(shape);
+
+        if (result == null) {
+            result = RopTranslator.translate(shape.buildRopMethod(),
+                    shape.getPositionInfo(), null, shape.getParamSize());
+            codes.put(shape, result);
+        }
+
+        return result;
+    }
+
+    /**
+     * Writes the classes added since the last flush as one dex file and
+     * starts a new one.
+     *
+     * @return {@code non-null;} the contents of the dex file
+     */
+    public byte[] flush() throws IOException {
+        try {
+            return file.toDex(null, false);
+        } finally {
+            file = new DexFile();
+            classCount = 0;
+            codes.clear();
+        }
+    }
+
+    /**
+     * Writes the classes added since the last flush to a jar at the
+     * location given by {@code pathHolder}, starts a new file and returns
+     * a class loader for the written classes.
+     *
+     * @param pathHolder {@code non-null;} where to write the dex and jar files
+     * @return {@code non-null;} a class loader for the written classes
+     */
+    public ClassLoader flush(PathHolder pathHolder) throws DexClassLoadingException {
+        FileOutputStream out = null;
+        try {
+            byte[] dex = flush();
+            out = new FileOutputStream(pathHolder.getDexFilePath());
+            out.write(dex);
+        } catch (IOException e) {
+            throw new DexClassLoadingException(e);
+        } finally {
+            try {
+                if (out != null) {
+                    out.close();
+                }
+            } catch (IOException e) {
+                // Ignoring deliberately in order to keep the original exception clear.
+            }
+        }
+
+        new DexJarMaker(pathHolder).create();
+        return DexClassLoaderHelper.getInstance().getDexClassLoader(pathHolder);
+    }
+
+    /**
+     * Source of the code of methods that share one body. Instances are
+     * used as keys of the translation cache: by default each instance is
+     * its own shape, and subclasses may override {@code equals()} and
+     * {@code hashCode()} to have equivalent instances share code. Only
+     * methods with the same prototype and the same constants may share
+     * code; a body referring to members of the generated class itself
+     * is different for each class.
+     */
+    public static abstract class MethodShape {
+        /**
+         * Builds the method body. Called at most once per flush.
+         *
+         * @return {@code non-null;} the method, which may be modified
+         * by the translation
+         */
+        protected abstract RopMethod buildRopMethod();
+
+        /**
+         * Gets the size, in register units, of all the parameters of the
+         * method.
+         *
+         * @return {@code >= 0;} the parameters size
+         */
+        protected abstract int getParamSize();
+
+        /**
+         * Gets how much position info to preserve; one of the static
+         * constants in {@link PositionList}. Defaults to none.
+         *
+         * @return the position info level
+         */
+        protected int getPositionInfo() {
+            return PositionList.NONE;
+        }
+    }
+}
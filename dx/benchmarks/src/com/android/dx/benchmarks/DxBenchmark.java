@@ -0,0 +1,659 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dx.benchmarks;
+
+import com.android.dex.ClassData;
+import com.android.dex.ClassDef;
+import com.android.dex.Dex;
+import com.android.dex.util.FileUtils;
+import com.android.dexdeps.DexData;
+import com.android.dx.Version;
+import com.android.dx.benchmarks.SyntheticClasses.ClassEntry;
+import com.android.dx.cf.direct.DirectClassFile;
+import com.android.dx.cf.direct.StdAttributeFactory;
+import com.android.dx.command.dexer.DxContext;
+import com.android.dx.command.dexer.Main;
+import com.android.dx.dex.DexOptions;
+import com.android.dx.dex.cf.CfOptions;
+import com.android.dx.dex.cf.CfTranslator;
+import com.android.dx.dex.file.ClassDefItem;
+import com.android.dx.dex.file.DexFile;
+import com.android.dx.io.instructions.DecodedInstruction;
+import com.android.dx.merge.CollisionPolicy;
+import com.android.dx.merge.DexMerger;
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.io.OutputStreamWriter;
+import java.io.PrintStream;
+import java.io.PrintWriter;
+import java.io.RandomAccessFile;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Enumeration;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Locale;
+import java.util.Set;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipFile;
+import java.util.zip.ZipOutputStream;
+
+/**
+ * Benchmarks the stages of the dx pipeline over synthetic inputs, the
+ * class files of the {@code dx/tests} corpus and arbitrary jars, and
+ * writes the results as JSON.
+ */
+public final class DxBenchmark {
+    private static final String USAGE_MESSAGE =
+            "usage: dx-benchmarks [--warmup=<n>] [--iterations=<n>] [--threads=<n>]\n" +
+            "  [--scale=<factor>] [--tests-dir=<dx/tests>] [--stages=<name>,...]\n" +
+            "  [--output=<file.json>] [<file>.jar ...]\n" +
+            "    Runs each stage over each input, --warmup times unrecorded then\n" +
+            "    --iterations times recorded, and writes the results as JSON.\n" +
+            "    --scale: multiplies the size of the synthetic inputs.\n" +
+            "    --tests-dir: adds the class files of each dx test as an input.\n" +
+            "    --stages: only runs the named stages, among:\n" +
+            "    " + Arrays.toString(Stages.ALL) + "\n";
+
+    /** number of units each synthetic input is split in, so that it can be merged */
+    private static final int SYNTHETIC_UNITS = 4;
+
+    private int warmup = 2;
+    private int iterations = 5;
+    private int threads = Runtime.getRuntime().availableProcessors();
+    private double scale = 1.0;
+    private File testsDir;
+    private Set<String> stages = new HashSet<String>(Arrays.asList(Stages.ALL));
+    private String output;
+    private final List<String> jars = new ArrayList<String>();
+
+    private File workDir;
+
+    private DxBenchmark() {
+    }
+
+    public static void main(String[] args) throws Exception {
+        DxBenchmark benchmark = new DxBenchmark();
+        try {
+            benchmark.parse(args);
+        } catch (IllegalArgumentException e) {
+            System.err.println(e.getMessage());
+            System.err.print(USAGE_MESSAGE);
+            System.exit(1);
+        }
+        benchmark.run();
+    }
+
+    private void parse(String[] args) {
+        for (String arg : args) {
+            if (arg.startsWith("--warmup=")) {
+                warmup = Integer.parseInt(value(arg));
+            } else if (arg.startsWith("--iterations=")) {
+                iterations = Integer.parseInt(value(arg));
+            } else if (arg.startsWith("--threads=")) {
+                threads = Integer.parseInt(value(arg));
+            } else if (arg.startsWith("--scale=")) {
+                scale = Double.parseDouble(value(arg));
+            } else if (arg.startsWith("--tests-dir=")) {
+                testsDir = new File(value(arg));
+            } else if (arg.startsWith("--stages=")) {
+                stages = new HashSet<String>(Arrays.asList(value(arg).split(",")));
+            } else if (arg.startsWith("--output=")) {
+                output = value(arg);
+            } else if (arg.startsWith("--")) {
+                throw new IllegalArgumentException("unknown option " + arg);
+            } else {
+                jars.add(arg);
+            }
+        }
+        if (iterations < 1 || warmup < 0 || threads < 1 || scale <= 0
+                || Double.isNaN(scale) || Double.isInfinite(scale)) {
+            throw new IllegalArgumentException("invalid option value");
+        }
+    }
+
+    private static String value(String arg) {
+        return arg.substring(arg.indexOf('=') + 1);
+    }
+
+    private void run() throws Exception {
+        workDir = File.createTempFile("dx-benchmarks", "");
+        workDir.delete();
+        workDir.mkdirs();
+        try {
+            List<Input> inputs = createInputs();
+            List<Stage.Result> results = new ArrayList<Stage.Result>();
+            int dexCount = 0;
+            for (Input input : inputs) {
+                input.prepare();
+                for (Stage stage : Stages.forInput(this, input)) {
+                    results.add(measure(stage));
+                }
+                dexCount += input.dexes.size();
+            }
+            if (dexCount > 1 && stages.contains(Stages.MERGE)) {
+                results.add(measure(Stages.merge("all", inputs)));
+            }
+            writeJson(results);
+        } finally {
+            delete(workDir);
+        }
+    }
+
+    private Stage.Result measure(Stage stage) throws Exception {
+        System.err.println("running " + stage.name + " on " + stage.input);
+        return stage.measure(warmup, iterations);
+    }
+
+    private List<Input> createInputs() throws IOException {
+        List<Input> inputs = new ArrayList<Input>();
+        inputs.add(Input.split("synthetic-many-classes",
+                SyntheticClasses.manyClasses(scaled(4000)), SYNTHETIC_UNITS));
+        inputs.add(Input.split("synthetic-huge-methods",
+                SyntheticClasses.hugeMethods(scaled(8)), SYNTHETIC_UNITS));
+        inputs.add(Input.split("synthetic-many-strings",
+                SyntheticClasses.manyStrings(scaled(200), 500), SYNTHETIC_UNITS));
+
+        if (testsDir != null) {
+            Input tests = new Input("dx-tests");
+            File[] testDirs = testsDir.listFiles();
+            if (testDirs == null) {
+                throw new IOException(testsDir + ": not a directory");
+            }
+            Arrays.sort(testDirs);
+            for (File testDir : testDirs) {
+                List<ClassEntry> unit = new ArrayList<ClassEntry>();
+                collectClasses(testDir, "", unit);
+                if (!unit.isEmpty()) {
+                    tests.units.add(unit);
+                }
+            }
+            inputs.add(tests);
+        }
+
+        for (String jar : jars) {
+            Input input = new Input(new File(jar).getName());
+            input.units.add(readJar(new File(jar)));
+            inputs.add(input);
+        }
+
+        for (Input input : inputs) {
+            input.workDir = new File(workDir, input.name);
+            input.workDir.mkdirs();
+        }
+        return inputs;
+    }
+
+    private int scaled(int count) {
+        return Math.max(SYNTHETIC_UNITS, (int) Math.round(count * scale));
+    }
+
+    private static void collectClasses(File dir, String prefix, List<ClassEntry> into) {
+        File[] files = dir.listFiles();
+        if (files == null) {
+            return;
+        }
+        Arrays.sort(files);
+        for (File file : files) {
+            if (file.isDirectory()) {
+                collectClasses(file, prefix + file.getName() + "/", into);
+            } else if (file.getName().endsWith(".class")) {
+                into.add(new ClassEntry(prefix + file.getName(), FileUtils.readFile(file)));
+            }
+        }
+    }
+
+    private static List<ClassEntry> readJar(File jar) throws IOException {
+        List<ClassEntry> result = new ArrayList<ClassEntry>();
+        ZipFile zip = new ZipFile(jar);
+        try {
+            for (Enumeration<? extends ZipEntry> entries = zip.entries();
+                    entries.hasMoreElements();) {
+                ZipEntry entry = entries.nextElement();
+                if (entry.getName().endsWith(".class")
+                        && !entry.getName().endsWith("module-info.class")) {
+                    InputStream in = zip.getInputStream(entry);
+                    try {
+                        result.add(new ClassEntry(entry.getName(), readFully(in)));
+                    } finally {
+                        in.close();
+                    }
+                }
+            }
+        } finally {
+            zip.close();
+        }
+        return result;
+    }
+
+    private static byte[] readFully(InputStream in) throws IOException {
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        byte[] buffer = new byte[8192];
+        for (int amt; (amt = in.read(buffer)) != -1;) {
+            out.write(buffer, 0, amt);
+        }
+        return out.toByteArray();
+    }
+
+    private static void delete(File file) {
+        File[] children = file.listFiles();
+        if (children != null) {
+            for (File child : children) {
+                delete(child);
+            }
+        }
+        file.delete();
+    }
+
+    private void writeJson(List<Stage.Result> results) throws IOException {
+        OutputStream rawOut = output == null ? System.out : new FileOutputStream(output);
+        PrintWriter out = new PrintWriter(new OutputStreamWriter(rawOut, "UTF-8"));
+        out.println("{");
+        out.println("  \"dxVersion\": " + quote(Version.VERSION) + ",");
+        out.println("  \"javaVersion\": " + quote(System.getProperty("java.version")) + ",");
+        out.println("  \"availableProcessors\": "
+                + Runtime.getRuntime().availableProcessors() + ",");
+        out.println("  \"maxHeapBytes\": " + Runtime.getRuntime().maxMemory() + ",");
+        out.println("  \"warmup\": " + warmup + ",");
+        out.println("  \"iterations\": " + iterations + ",");
+        out.println("  \"threads\": " + threads + ",");
+        out.println("  \"scale\": " + scale + ",");
+        out.println("  \"results\": [");
+        for (int r = 0; r < results.size(); r++) {
+            Stage.Result result = results.get(r);
+            long[] sorted = result.nanos.clone();
+            Arrays.sort(sorted);
+            out.println("    {");
+            out.println("      \"stage\": " + quote(result.stage) + ",");
+            out.println("      \"input\": " + quote(result.input) + ",");
+            out.println("      \"classes\": " + result.classes + ",");
+            out.println("      \"medianMs\": " + millis(result.medianNanos()) + ",");
+            out.println("      \"minMs\": " + millis(sorted[0]) + ",");
+            out.println("      \"maxMs\": " + millis(sorted[sorted.length - 1]) + ",");
+            out.println("      \"classesPerSecond\": "
+                    + String.format(Locale.ROOT, "%.1f", result.classesPerSecond()) + ",");
+            out.println("      \"timesMs\": " + millis(result.nanos) + ",");
+            out.println("      \"allocatedBytes\": " + Arrays.toString(result.allocatedBytes)
+                    + ",");
+            out.println("      \"peakHeapBytes\": " + Arrays.toString(result.peakHeapBytes));
+            out.println(r == results.size() - 1 ? "    }" : "    },");
+        }
+        out.println("  ]");
+        out.println("}");
+        out.flush();
+        if (output != null) {
+            out.close();
+        }
+    }
+
+    private static String millis(long nanos) {
+        return String.format(Locale.ROOT, "%.3f", nanos / 1e6);
+    }
+
+    private static String millis(long[] nanos) {
+        StringBuilder sb = new StringBuilder("[");
+        for (int i = 0; i < nanos.length; i++) {
+            if (i > 0) {
+                sb.append(", ");
+            }
+            sb.append(millis(nanos[i]));
+        }
+        return sb.append(']').toString();
+    }
+
+    private static String quote(String value) {
+        StringBuilder sb = new StringBuilder("\"");
+        for (int i = 0; i < value.length(); i++) {
+            char c = value.charAt(i);
+            if (c == '"' || c == '\\') {
+                sb.append('\\').append(c);
+            } else if (c < 0x20) {
+                sb.append(String.format(Locale.ROOT, "\\u%04x", (int) c));
+            } else {
+                sb.append(c);
+            }
+        }
+        return sb.append('"').toString();
+    }
+
+    /**
+     * A named benchmark input, made of units that are each translated into
+     * one dex file.
+     */
+    static final class Input {
+        final String name;
+        final List<List<ClassEntry>> units = new ArrayList<List<ClassEntry>>();
+        File workDir;
+
+        /** archive of each unit, for the stages that run the dx command */
+        final List<File> jars = new ArrayList<File>();
+
+        /** dex of each unit, for the stages that read or merge dex files */
+        final List<byte[]> dexes = new ArrayList<byte[]>();
+        final List<File> dexFiles = new ArrayList<File>();
+
+        Input(String name) {
+            this.name = name;
+        }
+
+        static Input split(String name, List<ClassEntry> classes, int unitCount) {
+            Input input = new Input(name);
+            for (int u = 0; u < unitCount; u++) {
+                int from = classes.size() * u / unitCount;
+                int to = classes.size() * (u + 1) / unitCount;
+                input.units.add(new ArrayList<ClassEntry>(classes.subList(from, to)));
+            }
+            return input;
+        }
+
+        int classCount() {
+            int count = 0;
+            for (List<ClassEntry> unit : units) {
+                count += unit.size();
+            }
+            return count;
+        }
+
+        /**
+         * Translates each unit once, dropping the units dx rejects, like
+         * the negative tests of {@code dx/tests}, and writes the archives
+         * and dex files used by the stages.
+         */
+        void prepare() throws IOException {
+            List<List<ClassEntry>> accepted = new ArrayList<List<ClassEntry>>();
+            for (List<ClassEntry> unit : units) {
+                byte[] dex;
+                try {
+                    dex = translate(unit, true).toDex(null, false);
+                } catch (RuntimeException e) {
+                    System.err.println(name + ": skipping unit rejected by dx: " + e);
+                    continue;
+                }
+                int index = accepted.size();
+                accepted.add(unit);
+                dexes.add(dex);
+
+                File dexFile = new File(workDir, index + ".dex");
+                writeFile(dexFile, dex);
+                dexFiles.add(dexFile);
+
+                File jar = new File(workDir, index + ".jar");
+                ZipOutputStream zip = new ZipOutputStream(new FileOutputStream(jar));
+                try {
+                    for (ClassEntry entry : unit) {
+                        zip.putNextEntry(new ZipEntry(entry.name));
+                        zip.write(entry.bytes);
+                        zip.closeEntry();
+                    }
+                } finally {
+                    zip.close();
+                }
+                jars.add(jar);
+            }
+            units.clear();
+            units.addAll(accepted);
+        }
+
+        private static void writeFile(File file, byte[] bytes) throws IOException {
+            OutputStream out = new FileOutputStream(file);
+            try {
+                out.write(bytes);
+            } finally {
+                out.close();
+            }
+        }
+    }
+
+    /**
+     * Translates class files into a new dex file, like {@code dx --dex}
+     * with its default options but without its thread pools.
+     */
+    static DexFile translate(List<ClassEntry> unit, boolean optimize) {
+        DxContext context = new DxContext();
+        CfOptions cfOptions = new CfOptions();
+        cfOptions.optimize = optimize;
+        cfOptions.localInfo = true;
+        cfOptions.strictNameCheck = false;
+        cfOptions.warn = new PrintStream(new OutputStream() {
+            @Override
+            public void write(int b) {
+                // warnings are not part of the measurement
+            }
+        });
+        DexOptions dexOptions = new DexOptions(context.err);
+        DexFile dexFile = new DexFile(dexOptions);
+        for (ClassEntry entry : unit) {
+            DirectClassFile cf = new DirectClassFile(entry.bytes, entry.name, false);
+            cf.setAttributeFactory(StdAttributeFactory.THE_ONE);
+            cf.getMagic(); // triggers the actual parsing
+            ClassDefItem clazz = CfTranslator.translate(context, cf, entry.bytes, cfOptions,
+                    dexOptions, dexFile);
+            dexFile.add(clazz);
+        }
+        return dexFile;
+    }
+
+    /**
+     * The benchmarked stages.
+     */
+    static final class Stages {
+        static final String CF_TRANSLATE = "cf-translate";
+        static final String CF_TRANSLATE_NO_OPTIMIZE = "cf-translate-no-optimize";
+        static final String DEX_WRITE = "dex-write";
+        static final String DX_SINGLE_THREAD = "dx-single-thread";
+        static final String DX_MULTI_THREAD = "dx-multi-thread";
+        static final String MERGE = "merge";
+        static final String DEX_READ = "dex-read";
+        static final String DEXDEPS = "dexdeps";
+
+        static final String[] ALL = {
+            CF_TRANSLATE, CF_TRANSLATE_NO_OPTIMIZE, DEX_WRITE, DX_SINGLE_THREAD,
+            DX_MULTI_THREAD, MERGE, DEX_READ, DEXDEPS
+        };
+
+        private Stages() {
+        }
+
+        static List<Stage> forInput(DxBenchmark benchmark, final Input input) {
+            List<Stage> result = new ArrayList<Stage>();
+            if (input.units.isEmpty()) {
+                return result;
+            }
+            final int classCount = input.classCount();
+            Set<String> selected = benchmark.stages;
+
+            if (selected.contains(CF_TRANSLATE)) {
+                result.add(new Stage(CF_TRANSLATE, input.name) {
+                    @Override
+                    int run() {
+                        for (List<ClassEntry> unit : input.units) {
+                            translate(unit, true);
+                        }
+                        return classCount;
+                    }
+                });
+            }
+
+            if (selected.contains(CF_TRANSLATE_NO_OPTIMIZE)) {
+                result.add(new Stage(CF_TRANSLATE_NO_OPTIMIZE, input.name) {
+                    @Override
+                    int run() {
+                        for (List<ClassEntry> unit : input.units) {
+                            translate(unit, false);
+                        }
+                        return classCount;
+                    }
+                });
+            }
+
+            if (selected.contains(DEX_WRITE)) {
+                result.add(new Stage(DEX_WRITE, input.name) {
+                    private final List<DexFile> dexFiles = new ArrayList<DexFile>();
+
+                    @Override
+                    void setUp() {
+                        dexFiles.clear();
+                        for (List<ClassEntry> unit : input.units) {
+                            dexFiles.add(translate(unit, true));
+                        }
+                    }
+
+                    @Override
+                    int run() throws IOException {
+                        for (DexFile dexFile : dexFiles) {
+                            dexFile.toDex(null, false);
+                        }
+                        dexFiles.clear();
+                        return classCount;
+                    }
+                });
+            }
+
+            if (selected.contains(DX_SINGLE_THREAD)) {
+                result.add(dx(DX_SINGLE_THREAD, input, 1));
+            }
+
+            if (selected.contains(DX_MULTI_THREAD)) {
+                result.add(dx(DX_MULTI_THREAD, input, benchmark.threads));
+            }
+
+            if (selected.contains(MERGE) && input.units.size() > 1) {
+                result.add(merge(input.name, Arrays.asList(input)));
+            }
+
+            if (selected.contains(DEX_READ)) {
+                result.add(new Stage(DEX_READ, input.name) {
+                    @Override
+                    int run() throws IOException {
+                        int classes = 0;
+                        for (byte[] bytes : input.dexes) {
+                            classes += readDex(new Dex(bytes));
+                        }
+                        return classes;
+                    }
+                });
+            }
+
+            if (selected.contains(DEXDEPS)) {
+                result.add(new Stage(DEXDEPS, input.name) {
+                    @Override
+                    int run() throws IOException {
+                        for (File dexFile : input.dexFiles) {
+                            RandomAccessFile raf = new RandomAccessFile(dexFile, "r");
+                            try {
+                                DexData dexData = new DexData(raf);
+                                dexData.load();
+                                dexData.getExternalReferences();
+                            } finally {
+                                raf.close();
+                            }
+                        }
+                        return classCount;
+                    }
+                });
+            }
+
+            return result;
+        }
+
+        /**
+         * Runs the dx command on each unit of {@code input}.
+         */
+        private static Stage dx(String name, final Input input, final int numThreads) {
+            final File out = new File(input.workDir, name + ".dex");
+            final int classCount = input.classCount();
+            return new Stage(name, input.name) {
+                @Override
+                int run() throws IOException {
+                    for (File jar : input.jars) {
+                        DxContext context = new DxContext();
+                        Main.Arguments arguments = new Main.Arguments(context);
+                        arguments.parseFlags(new String[] {
+                            "--output=" + out.getPath(),
+                            "--num-threads=" + numThreads
+                        });
+                        arguments.fileNames = new String[] { jar.getPath() };
+                        if (new Main(context).runDx(arguments) != 0) {
+                            throw new IllegalStateException("dx failed on " + jar);
+                        }
+                    }
+                    return classCount;
+                }
+            };
+        }
+
+        /**
+         * Merges the dex files of {@code inputs} into one. Classes defined
+         * by several inputs are kept once, and counted once.
+         */
+        static Stage merge(String inputName, final List<Input> inputs) {
+            return new Stage(MERGE, inputName) {
+                private Dex[] dexes;
+
+                @Override
+                void setUp() throws IOException {
+                    List<Dex> list = new ArrayList<Dex>();
+                    for (Input input : inputs) {
+                        for (byte[] bytes : input.dexes) {
+                            list.add(new Dex(bytes));
+                        }
+                    }
+                    dexes = list.toArray(new Dex[list.size()]);
+                }
+
+                @Override
+                int run() throws IOException {
+                    Dex merged = new DexMerger(dexes, CollisionPolicy.KEEP_FIRST,
+                            new DxContext()).merge();
+                    dexes = null;
+                    return merged.getTableOfContents().classDefs.size;
+                }
+            };
+        }
+
+        /**
+         * Reads all the tables and decodes all the code of {@code dex}.
+         *
+         * @return the number of classes read
+         */
+        private static int readDex(Dex dex) {
+            int classes = 0;
+            dex.strings().toArray();
+            dex.typeNames().toArray();
+            dex.protoIds().toArray();
+            dex.fieldIds().toArray();
+            dex.methodIds().toArray();
+            for (ClassDef classDef : dex.classDefs()) {
+                classes++;
+                if (classDef.getClassDataOffset() == 0) {
+                    continue;
+                }
+                ClassData classData = dex.readClassData(classDef);
+                for (ClassData.Method method : classData.allMethods()) {
+                    if (method.getCodeOffset() != 0) {
+                        DecodedInstruction.decodeAll(dex.readCode(method).getInstructions());
+                    }
+                }
+            }
+            return classes;
+        }
+    }
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dx.benchmarks;
+
+import java.lang.management.ManagementFactory;
+import java.lang.management.MemoryMXBean;
+import java.lang.management.ThreadMXBean;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.Map;
+
+/**
+ * One measured step of the dx pipeline. Each iteration runs the untimed
+ * {@link #setUp} then the measured {@link #run}, recording wall time,
+ * bytes allocated by all threads and peak heap usage.
+ */
+abstract class Stage {
+    /**
+     * interval between two samples of the per-thread allocation counters
+     * and of the heap usage
+     */
+    private static final long SAMPLE_INTERVAL_MS = 5;
+
+    final String name;
+    final String input;
+
+    Stage(String name, String input) {
+        this.name = name;
+        this.input = input;
+    }
+
+    /**
+     * Prepares one iteration. Not measured.
+     */
+    void setUp() throws Exception {
+        // This space intentionally left blank.
+    }
+
+    /**
+     * Runs one iteration.
+     *
+     * @return the number of classes processed
+     */
+    abstract int run() throws Exception;
+
+    /**
+     * Runs {@code warmup} unrecorded iterations then {@code iterations}
+     * recorded ones.
+     */
+    final Result measure(int warmup, int iterations) throws Exception {
+        for (int i = 0; i < warmup; i++) {
+            setUp();
+            run();
+        }
+
+        Result result = new Result(name, input, iterations);
+        for (int i = 0; i < iterations; i++) {
+            setUp();
+            System.gc();
+            AllocationSampler sampler = new AllocationSampler();
+            sampler.start();
+            long start = System.nanoTime();
+            result.classes = run();
+            result.nanos[i] = System.nanoTime() - start;
+            result.allocatedBytes[i] = sampler.finish();
+            result.peakHeapBytes[i] = sampler.peakHeap;
+        }
+        return result;
+    }
+
+    /**
+     * Measured values of a stage.
+     */
+    static final class Result {
+        final String stage;
+        final String input;
+        int classes;
+        final long[] nanos;
+        final long[] allocatedBytes;
+        final long[] peakHeapBytes;
+
+        Result(String stage, String input, int iterations) {
+            this.stage = stage;
+            this.input = input;
+            this.nanos = new long[iterations];
+            this.allocatedBytes = new long[iterations];
+            this.peakHeapBytes = new long[iterations];
+        }
+
+        long medianNanos() {
+            long[] sorted = nanos.clone();
+            Arrays.sort(sorted);
+            return sorted[sorted.length / 2];
+        }
+
+        double classesPerSecond() {
+            long median = medianNanos();
+            return median == 0 ? 0 : classes * 1e9 / median;
+        }
+    }
+
+    /**
+     * Sums the bytes allocated by all threads while a stage runs. dx runs
+     * work on short lived pool threads, so their counters are sampled
+     * periodically and the last value seen for each thread is kept. Bytes
+     * allocated by a pool thread after its last sample are not counted.
+     * The used heap is sampled along, and its highest value is kept as
+     * the peak heap usage.
+     */
+    private static final class AllocationSampler extends Thread {
+        private final com.sun.management.ThreadMXBean threads =
+                (com.sun.management.ThreadMXBean) ManagementFactory.getThreadMXBean();
+        private final Map<Long, Long> baseline = new HashMap<Long, Long>();
+        private final Map<Long, Long> latest = new HashMap<Long, Long>();
+        private final MemoryMXBean memory = ManagementFactory.getMemoryMXBean();
+        private volatile boolean done;
+
+        /** highest used heap seen; only valid after {@link #finish} */
+        long peakHeap;
+
+        AllocationSampler() {
+            setDaemon(true);
+            threads.setThreadAllocatedMemoryEnabled(true);
+            sample(baseline);
+        }
+
+        @Override
+        public void run() {
+            while (!done) {
+                synchronized (latest) {
+                    sample(latest);
+                }
+                try {
+                    Thread.sleep(SAMPLE_INTERVAL_MS);
+                } catch (InterruptedException e) {
+                    return;
+                }
+            }
+        }
+
+        /**
+         * Stops sampling and returns the bytes allocated since this
+         * sampler was created.
+         */
+        long finish() throws InterruptedException {
+            done = true;
+            join();
+            long total = 0;
+            synchronized (latest) {
+                sample(latest);
+                for (Map.Entry<Long, Long> entry : latest.entrySet()) {
+                    Long before = baseline.get(entry.getKey());
+                    total += entry.getValue() - (before == null ? 0 : before);
+                }
+            }
+            return total;
+        }
+
+        private void sample(Map<Long, Long> into) {
+            peakHeap = Math.max(peakHeap, memory.getHeapMemoryUsage().getUsed());
+            long[] ids = threads.getAllThreadIds();
+            long[] allocated = threads.getThreadAllocatedBytes(ids);
+            for (int i = 0; i < ids.length; i++) {
+                if (ids[i] != getId() && allocated[i] >= 0) {
+                    into.put(ids[i], allocated[i]);
+                }
+            }
+        }
+    }
+}
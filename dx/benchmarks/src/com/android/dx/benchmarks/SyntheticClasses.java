@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dx.benchmarks;
+
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+
+/**
+ * Generates class files that stress specific parts of dx. The output is
+ * fully determined by the parameters, so that results stay comparable
+ * between runs.
+ */
+final class SyntheticClasses {
+    private static final String PACKAGE = "com/android/dx/benchmarks/gen/";
+
+    /** number of locals used by the generated huge methods */
+    private static final int HUGE_METHOD_LOCALS = 10;
+
+    /** bytes of code emitted per statement of a huge method */
+    private static final int HUGE_METHOD_STATEMENT_SIZE = 7;
+
+    /** upper bound of the code size of a method */
+    private static final int MAX_CODE_SIZE = 65535;
+
+    private SyntheticClasses() {
+        // This space intentionally left blank.
+    }
+
+    /**
+     * Generates {@code classCount} small classes calling each other, with
+     * a static field each.
+     */
+    static List<ClassEntry> manyClasses(int classCount) {
+        List<ClassEntry> result = new ArrayList<ClassEntry>(classCount);
+        for (int i = 0; i < classCount; i++) {
+            String name = PACKAGE + "Many" + i;
+            String next = PACKAGE + "Many" + ((i + 1) % classCount);
+            ClassWriter cw = new ClassWriter(name);
+            cw.addField(0x0009 /* public static */, "counter", "I");
+
+            // static int call(int x) { counter += x; return x < 0 ? x : Next.call(x - 1); }
+            Code code = new Code(2, 1);
+            code.op(0xb2).u2(cw.fieldRef(name, "counter", "I"));  // getstatic
+            code.op(0x1a);                                        // iload_0
+            code.op(0x60);                                        // iadd
+            code.op(0xb3).u2(cw.fieldRef(name, "counter", "I"));  // putstatic
+            code.op(0x1a);                                        // iload_0
+            code.op(0x9c).u2(5);                                  // ifge +5
+            code.op(0x1a);                                        // iload_0
+            code.op(0xac);                                        // ireturn
+            code.op(0x1a);                                        // iload_0
+            code.op(0x04);                                        // iconst_1
+            code.op(0x64);                                        // isub
+            code.op(0xb8).u2(cw.methodRef(next, "call", "(I)I")); // invokestatic
+            code.op(0xac);                                        // ireturn
+            cw.addMethod(0x0009 /* public static */, "call", "(I)I", code);
+            result.add(cw.toClassEntry());
+        }
+        return result;
+    }
+
+    /**
+     * Generates {@code classCount} classes with one method as large as the
+     * class file format allows, made of arithmetic over many live locals.
+     */
+    static List<ClassEntry> hugeMethods(int classCount) {
+        int statements = (MAX_CODE_SIZE - 64) / HUGE_METHOD_STATEMENT_SIZE;
+        List<ClassEntry> result = new ArrayList<ClassEntry>(classCount);
+        for (int i = 0; i < classCount; i++) {
+            ClassWriter cw = new ClassWriter(PACKAGE + "Huge" + i);
+            Code code = new Code(2, HUGE_METHOD_LOCALS);
+            for (int local = 1; local < HUGE_METHOD_LOCALS; local++) {
+                code.op(0x1a);                  // iload_0
+                code.op(0x36).u1(local);        // istore
+            }
+            for (int s = 0; s < statements; s++) {
+                int seed = s + i;
+                code.op(0x15).u1(seed % HUGE_METHOD_LOCALS);                   // iload
+                code.op(0x15).u1((seed * 3 + 1) % HUGE_METHOD_LOCALS);         // iload
+                code.op((seed & 1) == 0 ? 0x60 : 0x68);                        // iadd / imul
+                code.op(0x36).u1((seed * 7 + 2) % HUGE_METHOD_LOCALS);         // istore
+            }
+            code.op(0x15).u1(HUGE_METHOD_LOCALS - 1);  // iload
+            code.op(0xac);                             // ireturn
+            cw.addMethod(0x0009 /* public static */, "compute", "(I)I", code);
+            result.add(cw.toClassEntry());
+        }
+        return result;
+    }
+
+    /**
+     * Generates {@code classCount} classes each loading
+     * {@code stringsPerClass} distinct string constants.
+     */
+    static List<ClassEntry> manyStrings(int classCount, int stringsPerClass) {
+        List<ClassEntry> result = new ArrayList<ClassEntry>(classCount);
+        for (int i = 0; i < classCount; i++) {
+            ClassWriter cw = new ClassWriter(PACKAGE + "Strings" + i);
+            Code code = new Code(1, 0);
+            for (int s = 0; s < stringsPerClass; s++) {
+                code.op(0x13).u2(cw.string("string-" + i + "-" + s + "-" + (s * 31 + i)));
+                code.op(0x57);                 // pop
+            }
+            code.op(0xb1);                     // return
+            cw.addMethod(0x0009 /* public static */, "strings", "()V", code);
+            result.add(cw.toClassEntry());
+        }
+        return result;
+    }
+
+    /**
+     * A class file, named after its path in an archive.
+     */
+    static final class ClassEntry {
+        final String name;
+        final byte[] bytes;
+
+        ClassEntry(String name, byte[] bytes) {
+            this.name = name;
+            this.bytes = bytes;
+        }
+    }
+
+    /**
+     * Bytecode of a method body.
+     */
+    private static final class Code {
+        final int maxStack;
+        final int maxLocals;
+        final ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+
+        Code(int maxStack, int maxLocals) {
+            this.maxStack = maxStack;
+            this.maxLocals = maxLocals;
+        }
+
+        Code op(int opcode) {
+            return u1(opcode);
+        }
+
+        Code u1(int value) {
+            bytes.write(value);
+            return this;
+        }
+
+        Code u2(int value) {
+            bytes.write(value >> 8);
+            bytes.write(value);
+            return this;
+        }
+    }
+
+    /**
+     * Minimal writer of version 50 class files, extending
+     * {@code java.lang.Object} with a default constructor.
+     */
+    private static final class ClassWriter {
+        private final String name;
+        private final ByteArrayOutputStream pool = new ByteArrayOutputStream();
+        private final DataOutputStream poolOut = new DataOutputStream(pool);
+        private final Map<String, Integer> poolIndexes = new HashMap<String, Integer>();
+        private int poolCount = 1;
+        private final ByteArrayOutputStream members = new ByteArrayOutputStream();
+        private final DataOutputStream membersOut = new DataOutputStream(members);
+        private int fieldCount;
+        private final ByteArrayOutputStream methods = new ByteArrayOutputStream();
+        private final DataOutputStream methodsOut = new DataOutputStream(methods);
+        private int methodCount;
+
+        ClassWriter(String name) {
+            this.name = name;
+            Code init = new Code(1, 1);
+            init.op(0x2a);                                                     // aload_0
+            init.op(0xb7).u2(methodRef("java/lang/Object", "<init>", "()V"));  // invokespecial
+            init.op(0xb1);                                                     // return
+            addMethod(0x0001 /* public */, "<init>", "()V", init);
+        }
+
+        int utf8(String value) {
+            Integer index = poolIndexes.get("U" + value);
+            if (index == null) {
+                try {
+                    poolOut.writeByte(1);
+                    poolOut.writeUTF(value);
+                } catch (IOException e) {
+                    throw new AssertionError(e);
+                }
+                index = add("U" + value);
+            }
+            return index;
+        }
+
+        int classRef(String className) {
+            return ref("C", 7, utf8(className), -1);
+        }
+
+        int string(String value) {
+            return ref("S", 8, utf8(value), -1);
+        }
+
+        int fieldRef(String owner, String fieldName, String type) {
+            return ref("F", 9, classRef(owner), nameAndType(fieldName, type));
+        }
+
+        int methodRef(String owner, String methodName, String type) {
+            return ref("M", 10, classRef(owner), nameAndType(methodName, type));
+        }
+
+        private int nameAndType(String memberName, String type) {
+            return ref("N", 12, utf8(memberName), utf8(type));
+        }
+
+        private int ref(String kind, int tag, int first, int second) {
+            String key = kind + first + ":" + second;
+            Integer index = poolIndexes.get(key);
+            if (index == null) {
+                try {
+                    poolOut.writeByte(tag);
+                    poolOut.writeShort(first);
+                    if (second >= 0) {
+                        poolOut.writeShort(second);
+                    }
+                } catch (IOException e) {
+                    throw new AssertionError(e);
+                }
+                index = add(key);
+            }
+            return index;
+        }
+
+        private Integer add(String key) {
+            Integer index = poolCount++;
+            poolIndexes.put(key, index);
+            return index;
+        }
+
+        void addField(int accessFlags, String fieldName, String type) {
+            try {
+                membersOut.writeShort(accessFlags);
+                membersOut.writeShort(utf8(fieldName));
+                membersOut.writeShort(utf8(type));
+                membersOut.writeShort(0);
+            } catch (IOException e) {
+                throw new AssertionError(e);
+            }
+            fieldCount++;
+        }
+
+        void addMethod(int accessFlags, String methodName, String type, Code code) {
+            try {
+                byte[] body = code.bytes.toByteArray();
+                methodsOut.writeShort(accessFlags);
+                methodsOut.writeShort(utf8(methodName));
+                methodsOut.writeShort(utf8(type));
+                methodsOut.writeShort(1);
+                methodsOut.writeShort(utf8("Code"));
+                methodsOut.writeInt(12 + body.length);
+                methodsOut.writeShort(code.maxStack);
+                methodsOut.writeShort(code.maxLocals);
+                methodsOut.writeInt(body.length);
+                methodsOut.write(body);
+                methodsOut.writeShort(0);
+                methodsOut.writeShort(0);
+            } catch (IOException e) {
+                throw new AssertionError(e);
+            }
+            methodCount++;
+        }
+
+        ClassEntry toClassEntry() {
+            int thisClass = classRef(name);
+            int superClass = classRef("java/lang/Object");
+            ByteArrayOutputStream result = new ByteArrayOutputStream();
+            DataOutputStream out = new DataOutputStream(result);
+            try {
+                out.writeInt(0xcafebabe);
+                out.writeShort(0);
+                out.writeShort(50);
+                out.writeShort(poolCount);
+                pool.writeTo(out);
+                out.writeShort(0x0021 /* public super */);
+                out.writeShort(thisClass);
+                out.writeShort(superClass);
+                out.writeShort(0);
+                out.writeShort(fieldCount);
+                members.writeTo(out);
+                out.writeShort(methodCount);
+                methods.writeTo(out);
+                out.writeShort(0);
+                out.flush();
+            } catch (IOException e) {
+                throw new AssertionError(e);
+            }
+            return new ClassEntry(name + ".class", result.toByteArray());
+        }
+    }
+}
@@ -91,6 +91,7 @@ set params=
 
 set output=
 set disableKeepAnnotated=
+set graphCache=
 
 :firstArg
 if [%1]==[] goto endArgs
@@ -110,6 +111,14 @@ if [%1]==[] goto endArgs
 
 :notDisable
 
+    if %1 NEQ --graph-cache goto notGraphCache
+        set "graphCache=--graph-cache=%2"
+        shift
+        shift
+        goto firstArg
+
+:notGraphCache
+
     if %1 NEQ --aapt-rules goto notAapt
         set "extrarules=%2"
         shift
@@ -135,10 +144,10 @@ set "exitStatus=0"
 call "%proguard%" -injars %params% -dontwarn -forceprocessing  -outjars "%tmpJar%" -libraryjars "%shrinkedAndroidJar%" -dontoptimize -dontobfuscate -dontpreverify -include "%baserules%" -include "%extrarules%" 1>nul
 
 if DEFINED output goto redirect
-call "%java_exe%" -Djava.ext.dirs="%frameworkdir%" com.android.multidex.MainDexListBuilder %disableKeepAnnotated% "%tmpJar%" "%params%"
+call "%java_exe%" -Djava.ext.dirs="%frameworkdir%" com.android.multidex.MainDexListBuilder %disableKeepAnnotated% %graphCache% "%tmpJar%" "%params%"
 goto afterClassReferenceListBuilder
 :redirect
-call "%java_exe%" -Djava.ext.dirs="%frameworkdir%" com.android.multidex.MainDexListBuilder %disableKeepAnnotated% "%tmpJar%" "%params%" 1>"%output%"
+call "%java_exe%" -Djava.ext.dirs="%frameworkdir%" com.android.multidex.MainDexListBuilder %disableKeepAnnotated% %graphCache% "%tmpJar%" "%params%" 1>"%output%"
 :afterClassReferenceListBuilder
 
 del %tmpJar%
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dex;
+
+import java.io.ByteArrayOutputStream;
+import java.util.Arrays;
+import junit.framework.TestCase;
+
+public final class StringIndexTest extends TestCase {
+    private static final String[] STRINGS = {
+        "",
+        "\u0000",
+        "\u0000a",
+        "A",
+        "Ljava/lang/Object;",
+        "a",
+        "a\u0000",
+        "ab",
+        "\u007f",
+        "\u0080",
+        "\u07ff",
+        "\u0800",
+        "\ud800\udc00",
+        "\uffff",
+    };
+
+    public void testGetAndHashCode() throws Exception {
+        StringIndex strings = indexOf(STRINGS);
+        assertEquals(STRINGS.length, strings.size());
+        for (int i = 0; i < STRINGS.length; i++) {
+            assertEquals(STRINGS[i], strings.get(i));
+            assertEquals(STRINGS[i].hashCode(), strings.hashOf(i));
+        }
+    }
+
+    public void testCompareMatchesStringOrder() throws Exception {
+        String[] sorted = STRINGS.clone();
+        Arrays.sort(sorted);
+        assertTrue(Arrays.equals(STRINGS, sorted));
+
+        StringIndex strings = indexOf(STRINGS);
+        for (int i = 0; i < STRINGS.length; i++) {
+            for (int j = 0; j < STRINGS.length; j++) {
+                assertEquals(STRINGS[i] + " vs " + STRINGS[j],
+                        Integer.signum(STRINGS[i].compareTo(STRINGS[j])),
+                        Integer.signum(strings.compare(i, strings, j)));
+                assertEquals(i == j, strings.sameString(i, strings, j));
+            }
+        }
+    }
+
+    /**
+     * Returns an index over string_ids at offset 0 followed by the string
+     * data of {@code values}.
+     */
+    private static StringIndex indexOf(String[] values) throws Exception {
+        ByteArrayOutputStream stringData = new ByteArrayOutputStream();
+        int[] offsets = new int[values.length];
+        int dataOff = values.length * SizeOf.STRING_ID_ITEM;
+        for (int i = 0; i < values.length; i++) {
+            offsets[i] = dataOff + stringData.size();
+            stringData.write(values[i].length()); // all lengths fit in one byte
+            stringData.write(Mutf8.encode(values[i]));
+            stringData.write(0);
+        }
+
+        ByteArrayOutputStream out = new ByteArrayOutputStream();
+        for (int offset : offsets) {
+            out.write(offset);
+            out.write(offset >> 8);
+            out.write(offset >> 16);
+            out.write(offset >> 24);
+        }
+        stringData.writeTo(out);
+        return new StringIndex(out.toByteArray(), 0, values.length);
+    }
+}
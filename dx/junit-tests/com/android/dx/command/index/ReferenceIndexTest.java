@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dx.command.index;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
+
+import com.android.dex.Dex;
+import com.android.dx.command.Main;
+import com.android.dx.command.findusages.FindUsages;
+import com.android.dx.command.grep.Grep;
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.PrintWriter;
+import java.io.StringWriter;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.regex.Pattern;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipOutputStream;
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.rules.TemporaryFolder;
+
+public class ReferenceIndexTest {
+    static class Referencing {
+        static final String GREETING = "hello index";
+        int counter;
+
+        String greet() {
+            counter++;
+            return GREETING.length() > 0 ? "hello there" : toString();
+        }
+
+        @Override
+        public String toString() {
+            return "hello again";
+        }
+    }
+
+    static class StaticValues {
+        // The int precedes the string in the static values array.
+        static final int ANSWER = 42;
+        static final String GREETING = "hello static";
+    }
+
+    @Rule
+    public TemporaryFolder temporaryFolder = new TemporaryFolder();
+
+    @Test
+    public void test_grep_matchesDexDecoding() throws IOException {
+        Dex dex = getDexForClass(Referencing.class);
+        ReferenceIndex index = roundTrip(ReferenceIndex.build(dex));
+        Pattern pattern = Pattern.compile("hello");
+
+        StringWriter expected = new StringWriter();
+        PrintWriter expectedOut = new PrintWriter(expected);
+        int expectedCount = new Grep(dex, pattern, expectedOut).grep();
+        expectedOut.flush();
+
+        StringWriter actual = new StringWriter();
+        PrintWriter actualOut = new PrintWriter(actual);
+        int actualCount = index.grep(pattern, actualOut);
+        actualOut.flush();
+
+        assertTrue(expectedCount > 0);
+        assertEquals(expectedCount, actualCount);
+        assertEquals(expected.toString(), actual.toString());
+    }
+
+    @Test
+    public void test_grep_findsStringsAfterOtherStaticValues() throws IOException {
+        Dex dex = getDexForClass(StaticValues.class);
+        ReferenceIndex index = roundTrip(ReferenceIndex.build(dex));
+        Pattern pattern = Pattern.compile("hello static");
+
+        StringWriter expected = new StringWriter();
+        PrintWriter expectedOut = new PrintWriter(expected);
+        int expectedCount = new Grep(dex, pattern, expectedOut).grep();
+        expectedOut.flush();
+
+        StringWriter actual = new StringWriter();
+        PrintWriter actualOut = new PrintWriter(actual);
+        int actualCount = index.grep(pattern, actualOut);
+        actualOut.flush();
+
+        assertEquals(1, expectedCount);
+        assertEquals(expectedCount, actualCount);
+        assertEquals(expected.toString(), actual.toString());
+    }
+
+    @Test
+    public void test_isIndexOf_comparesDexSignature() throws IOException {
+        File dexFile = new File(temporaryFolder.newFolder(), "classes.dex");
+        Dex dex = getDexForClass(Referencing.class);
+        dex.writeTo(dexFile);
+        File indexFile = ReferenceIndex.indexFileFor(dexFile);
+        ReferenceIndex.build(dex).writeTo(indexFile);
+        assertTrue(ReferenceIndex.isIndexOf(indexFile, dexFile));
+        // Only the dex and its index, no temporary file.
+        assertEquals(2, dexFile.getParentFile().list().length);
+
+        // Replace the dex, keeping its timestamp.
+        long lastModified = dexFile.lastModified();
+        getDexForClass(StaticValues.class).writeTo(dexFile);
+        dexFile.setLastModified(lastModified);
+        assertFalse(ReferenceIndex.isIndexOf(indexFile, dexFile));
+    }
+
+    @Test
+    public void test_findUsages_matchesDexDecoding() throws IOException {
+        Dex dex = getDexForClass(Referencing.class);
+        ReferenceIndex index = roundTrip(ReferenceIndex.build(dex));
+        assertFindUsages(dex, index, ".*Referencing;", "counter");
+        assertFindUsages(dex, index, ".*Referencing;", "toString");
+        assertFindUsages(dex, index, "Ljava/lang/Object;", "toString");
+        assertFindUsages(dex, index, "Ljava/lang/String;", "length");
+    }
+
+    private void assertFindUsages(Dex dex, ReferenceIndex index, String declaredBy,
+            String memberName) {
+        StringWriter expected = new StringWriter();
+        PrintWriter expectedOut = new PrintWriter(expected);
+        new FindUsages(dex, declaredBy, memberName, expectedOut).findUsages();
+        expectedOut.flush();
+
+        StringWriter actual = new StringWriter();
+        PrintWriter actualOut = new PrintWriter(actual);
+        index.findUsages(declaredBy, memberName, actualOut);
+        actualOut.flush();
+
+        assertTrue(!expected.toString().isEmpty());
+        assertEquals(expected.toString(), actual.toString());
+    }
+
+    private ReferenceIndex roundTrip(ReferenceIndex index) throws IOException {
+        File file = temporaryFolder.newFile("classes.dex" + ReferenceIndex.EXTENSION);
+        index.writeTo(file);
+        return ReferenceIndex.read(file);
+    }
+
+    private Dex getDexForClass(Class<?> clazz) throws IOException {
+        String path = clazz.getName().replace('.', '/') + ".class";
+        Path classesJar = temporaryFolder.newFile(clazz.getName() + ".jar").toPath();
+        try (InputStream in = getClass().getClassLoader().getResourceAsStream(path);
+             ZipOutputStream zip = new ZipOutputStream(Files.newOutputStream(classesJar))) {
+
+            ZipEntry entry = new ZipEntry(path);
+            zip.putNextEntry(entry);
+            zip.write(readEntireStream(in));
+            zip.closeEntry();
+        }
+
+        Path output = temporaryFolder.newFolder().toPath();
+        Main.main(new String[]{"--dex", "--output=" + output.toString(), classesJar.toString()});
+
+        return new Dex(Files.readAllBytes(output.resolve("classes.dex")));
+    }
+
+    private static byte[] readEntireStream(InputStream inputStream) throws IOException {
+        ByteArrayOutputStream bytesOut = new ByteArrayOutputStream();
+        byte[] buffer = new byte[8192];
+
+        int count;
+        while ((count = inputStream.read(buffer)) != -1) {
+            bytesOut.write(buffer, 0, count);
+        }
+
+        return bytesOut.toByteArray();
+    }
+}
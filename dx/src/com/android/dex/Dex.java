@@ -61,6 +61,7 @@ public final class Dex {
     private final TableOfContents tableOfContents = new TableOfContents();
     private int nextSectionStart = 0;
     private final StringTable strings = new StringTable();
+    private StringIndex stringIndex;
     private final TypeIndexToDescriptorIndexTable typeIds = new TypeIndexToDescriptorIndexTable();
     private final TypeIndexToDescriptorTable typeNames = new TypeIndexToDescriptorTable();
     private final ProtoIdTable protoIds = new ProtoIdTable();
@@ -314,6 +315,22 @@ public final class Dex {
         open(CHECKSUM_OFFSET).writeInt(computeChecksum());
     }
 
+    /**
+     * Returns the strings of this dex, scanned once and decoded on demand.
+     * The index is rebuilt if the string_ids of this dex have moved since
+     * it was last built.
+     */
+    public StringIndex stringIndex() {
+        TableOfContents.Section stringIds = tableOfContents.stringIds;
+        byte[] bytes = data.array();
+        StringIndex result = stringIndex;
+        if (result == null || !result.covers(bytes, stringIds.off, stringIds.size)) {
+            result = new StringIndex(bytes, stringIds.off, stringIds.size);
+            stringIndex = result;
+        }
+        return result;
+    }
+
     /**
      * Look up a descriptor index from a type index. Cheaper than:
      * {@code open(tableOfContents.typeIds.off + (index * SizeOf.TYPE_ID_ITEM)).readInt();}
@@ -682,6 +699,15 @@ public final class Dex {
             }
         }
 
+        /**
+         * Copies the string_data_item of string {@code index} of
+         * {@code strings} without decoding it.
+         */
+        public void writeStringData(StringIndex strings, int index) {
+            int offset = strings.itemOffset(index);
+            data.put(strings.data(), offset, strings.itemEnd(index) - offset);
+        }
+
         public void writeStringData(String value) {
             try {
                 int length = value.length();
@@ -714,8 +740,7 @@ public final class Dex {
         @Override
         public String get(int index) {
             checkBounds(index, tableOfContents.stringIds.size);
-            return open(tableOfContents.stringIds.off + (index * SizeOf.STRING_ID_ITEM))
-                    .readString();
+            return stringIndex().get(index);
         }
         @Override
         public int size() {
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dex;
+
+/**
+ * The string table of a dex file, scanned once. The location and hash of
+ * every string are computed up front so that strings can be hashed,
+ * compared and copied without decoding them; strings are decoded at most
+ * once, on first {@link #get}.
+ *
+ * <p>Comparisons run on the modified UTF-8 bytes. Their order is the
+ * order of UTF-16 code units required by the dex format, except for
+ * U+0000 whose two byte encoding {@code c0 80} must sort first. Since
+ * {@code 0xc0} is never otherwise used as a lead byte, a mismatch on that
+ * byte is enough to spot it.
+ */
+public final class StringIndex {
+    private final byte[] data;
+    private final int idsOff;
+    private final int size;
+
+    /** offset of the first encoded byte of each string */
+    private final int[] starts;
+
+    /** offset of the terminating zero of each string */
+    private final int[] ends;
+
+    /** {@link String#hashCode} of each string */
+    private final int[] hashes;
+
+    /** decoded strings, filled on demand */
+    private final String[] strings;
+
+    /**
+     * Scans {@code size} string_id_items at {@code idsOff} in {@code data}.
+     *
+     * @throws DexException if a string is malformed
+     */
+    public StringIndex(byte[] data, int idsOff, int size) {
+        this.data = data;
+        this.idsOff = idsOff;
+        this.size = size;
+        this.starts = new int[size];
+        this.ends = new int[size];
+        this.hashes = new int[size];
+        this.strings = new String[size];
+
+        for (int i = 0; i < size; i++) {
+            int p = itemOffset(i);
+            int expectedLength = 0;
+            int shift = 0;
+            int b;
+            do {
+                b = data[p++] & 0xff;
+                expectedLength |= (b & 0x7f) << shift;
+                shift += 7;
+            } while ((b & 0x80) != 0 && shift < 35);
+            starts[i] = p;
+
+            int hash = 0;
+            int length = 0;
+            while (data[p] != 0) {
+                int decoded = decodeChar(i, p);
+                hash = 31 * hash + (decoded >>> 2);
+                p += decoded & 3;
+                length++;
+            }
+            if (length != expectedLength) {
+                throw new DexException("Declared length " + expectedLength
+                        + " doesn't match decoded length of " + length);
+            }
+            ends[i] = p;
+            hashes[i] = hash;
+        }
+    }
+
+    /**
+     * Returns true if this index was built over the given string_ids.
+     */
+    boolean covers(byte[] data, int idsOff, int size) {
+        return this.data == data && this.idsOff == idsOff && this.size == size;
+    }
+
+    public int size() {
+        return size;
+    }
+
+    /**
+     * Returns the string at {@code index}, decoding it on first access.
+     */
+    public String get(int index) {
+        String result = strings[index];
+        if (result == null) {
+            char[] chars = new char[ends[index] - starts[index]];
+            int s = 0;
+            int p = starts[index];
+            int end = ends[index];
+            while (p < end) {
+                int decoded = decodeChar(index, p);
+                chars[s++] = (char) (decoded >>> 2);
+                p += decoded & 3;
+            }
+            result = new String(chars, 0, s);
+            // racing threads decode equal strings; either one may be kept
+            strings[index] = result;
+        }
+        return result;
+    }
+
+    /**
+     * Returns the hash code of the string at {@code index}, equal to
+     * {@code get(index).hashCode()}.
+     */
+    public int hashOf(int index) {
+        return hashes[index];
+    }
+
+    /**
+     * Compares the string at {@code index} with the string at
+     * {@code otherIndex} in {@code other}, in dex order.
+     */
+    public int compare(int index, StringIndex other, int otherIndex) {
+        byte[] otherData = other.data;
+        int p = starts[index];
+        int q = other.starts[otherIndex];
+        int end = ends[index];
+        int otherEnd = other.ends[otherIndex];
+        for (; p < end && q < otherEnd; p++, q++) {
+            int a = data[p] & 0xff;
+            int b = otherData[q] & 0xff;
+            if (a != b) {
+                if (a == 0xc0) {
+                    return -1;
+                } else if (b == 0xc0) {
+                    return 1;
+                }
+                return a - b;
+            }
+        }
+        return (end - p) - (otherEnd - q);
+    }
+
+    /**
+     * Returns true if the string at {@code index} equals the string at
+     * {@code otherIndex} in {@code other}.
+     */
+    public boolean sameString(int index, StringIndex other, int otherIndex) {
+        return hashes[index] == other.hashes[otherIndex]
+                && compare(index, other, otherIndex) == 0;
+    }
+
+    /**
+     * Decodes the code unit whose encoding starts at {@code p}, in the
+     * string at {@code index}. Returns the code unit shifted left by two,
+     * or'ed with the number of bytes it was encoded in.
+     *
+     * @throws DexException if the encoding is malformed
+     */
+    private int decodeChar(int index, int p) {
+        int a = data[p] & 0xff;
+        if (a < 0x80) {
+            return (a << 2) | 1;
+        } else if ((a & 0xe0) == 0xc0) {
+            int b1 = data[p + 1] & 0xff;
+            if ((b1 & 0xc0) != 0x80) {
+                throw new DexException("bad second byte in string " + index);
+            }
+            return ((((a & 0x1f) << 6) | (b1 & 0x3f)) << 2) | 2;
+        } else if ((a & 0xf0) == 0xe0) {
+            int b1 = data[p + 1] & 0xff;
+            int b2 = data[p + 2] & 0xff;
+            if (((b1 & 0xc0) != 0x80) || ((b2 & 0xc0) != 0x80)) {
+                throw new DexException("bad second or third byte in string " + index);
+            }
+            return ((((a & 0x0f) << 12) | ((b1 & 0x3f) << 6) | (b2 & 0x3f)) << 2) | 3;
+        } else {
+            throw new DexException("bad byte in string " + index);
+        }
+    }
+
+    /**
+     * Returns the offset of the string_data_item of the string at
+     * {@code index}.
+     */
+    int itemOffset(int index) {
+        int p = idsOff + index * SizeOf.STRING_ID_ITEM;
+        return (data[p] & 0xff)
+                | ((data[p + 1] & 0xff) << 8)
+                | ((data[p + 2] & 0xff) << 16)
+                | ((data[p + 3] & 0xff) << 24);
+    }
+
+    /**
+     * Returns the offset just past the string_data_item of the string at
+     * {@code index}, including its terminating zero.
+     */
+    int itemEnd(int index) {
+        return ends[index] + 1;
+    }
+
+    byte[] data() {
+        return data;
+    }
+}
@@ -56,10 +56,16 @@ public class Main {
         "  [--basic-blocks | --rop-blocks | --ssa-blocks | --dot] [--ssa-step=<step>]\n" +
         "  [--width=<n>] [<file>.class | <file>.txt] ...\n" +
         "    Dump classfiles, or transformations thereof, in a human-oriented format.\n" +
-        "  dx --find-usages <file.dex> <declaring type> <member>\n" +
+        "  dx --find-usages [--num-threads=<n>] <file.dex> ... <declaring type> <member>\n" +
         "    Find references and declarations to a field or method.\n" +
         "    <declaring type> is a class name in internal form, like Ljava/lang/Object;\n" +
         "    <member> is a field or method name, like hashCode.\n" +
+        "    Each <file.dex> may also be a reference index or a directory.\n" +
+        "  dx --grep [--num-threads=<n>] <file.dex> ... <pattern>\n" +
+        "    Find uses of strings matching <pattern>.\n" +
+        "  dx --index [--num-threads=<n>] [<file.dex> | <directory>] ...\n" +
+        "    Write the reference index of each dex to <file.dex>.refs; --find-usages\n" +
+        "    and --grep answer from an up to date index instead of decoding the dex.\n" +
         "  dx -J<option> ... <arguments, in one of the above forms>\n" +
         "    Pass VM-specific options to the virtual machine that runs dx.\n" +
         "  dx --version\n" +
@@ -104,6 +110,12 @@ public class Main {
                 } else if (arg.equals("--find-usages")) {
                     com.android.dx.command.findusages.Main.main(without(args, i));
                     break;
+                } else if (arg.equals("--grep")) {
+                    com.android.dx.command.grep.Main.main(without(args, i));
+                    break;
+                } else if (arg.equals("--index")) {
+                    com.android.dx.command.index.Main.main(without(args, i));
+                    break;
                 } else if (arg.equals("--version")) {
                     version();
                     break;
@@ -17,19 +17,42 @@
 package com.android.dx.command.findusages;
 
 import com.android.dex.Dex;
-import java.io.File;
+import com.android.dx.command.UsageException;
+import com.android.dx.command.index.CorpusQuery;
+import com.android.dx.command.index.ReferenceIndex;
 import java.io.IOException;
 import java.io.PrintWriter;
+import java.util.List;
 
+/**
+ * Prints the declarations of and references to a field or method, in dex
+ * files or in their prebuilt reference indexes.
+ *
+ * <p>usage: {@code [--num-threads=<n>] <file>... <declaring type> <member>},
+ * where each file is a dex, an index or a directory.</p>
+ */
 public final class Main {
     public static void main(String[] args) throws IOException {
-        String dexFile = args[0];
-        String declaredBy = args[1];
-        String memberName = args[2];
+        List<String> paths = CorpusQuery.asList(args);
+        int numThreads = CorpusQuery.parseNumThreads(paths);
+        if (paths.size() < 3) {
+            throw new UsageException();
+        }
+        final String memberName = paths.remove(paths.size() - 1);
+        final String declaredBy = paths.remove(paths.size() - 1);
+
+        new CorpusQuery() {
+            @Override
+            protected int query(Dex dex, PrintWriter out) {
+                new FindUsages(dex, declaredBy, memberName, out).findUsages();
+                return 0;
+            }
 
-        Dex dex = new Dex(new File(dexFile));
-        PrintWriter out = new PrintWriter(System.out);
-        new FindUsages(dex, declaredBy, memberName, out).findUsages();
-        out.flush();
+            @Override
+            protected int query(ReferenceIndex index, PrintWriter out) {
+                index.findUsages(declaredBy, memberName, out);
+                return 0;
+            }
+        }.run(paths, numThreads, new PrintWriter(System.out));
     }
 }
@@ -62,6 +62,9 @@ public final class Grep {
             case EncodedValueReader.ENCODED_ARRAY:
                 readArray(reader);
                 break;
+            default:
+                reader.skipValue();
+                break;
             }
         }
     }
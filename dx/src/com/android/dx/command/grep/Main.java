@@ -17,18 +17,41 @@
 package com.android.dx.command.grep;
 
 import com.android.dex.Dex;
-import java.io.File;
+import com.android.dx.command.UsageException;
+import com.android.dx.command.index.CorpusQuery;
+import com.android.dx.command.index.ReferenceIndex;
 import java.io.IOException;
 import java.io.PrintWriter;
+import java.util.List;
 import java.util.regex.Pattern;
 
+/**
+ * Prints the uses of strings matching a pattern, in dex files or in their
+ * prebuilt reference indexes.
+ *
+ * <p>usage: {@code [--num-threads=<n>] <file>... <pattern>}, where each
+ * file is a dex, an index or a directory.</p>
+ */
 public final class Main {
     public static void main(String[] args) throws IOException {
-        String dexFile = args[0];
-        String pattern = args[1];
+        List<String> paths = CorpusQuery.asList(args);
+        int numThreads = CorpusQuery.parseNumThreads(paths);
+        if (paths.size() < 2) {
+            throw new UsageException();
+        }
+        final Pattern pattern = Pattern.compile(paths.remove(paths.size() - 1));
+
+        int count = new CorpusQuery() {
+            @Override
+            protected int query(Dex dex, PrintWriter out) {
+                return new Grep(dex, pattern, out).grep();
+            }
 
-        Dex dex = new Dex(new File(dexFile));
-        int count = new Grep(dex, Pattern.compile(pattern), new PrintWriter(System.out)).grep();
+            @Override
+            protected int query(ReferenceIndex index, PrintWriter out) {
+                return index.grep(pattern, out);
+            }
+        }.run(paths, numThreads, new PrintWriter(System.out));
         System.exit((count > 0) ? 0 : 1);
     }
 }
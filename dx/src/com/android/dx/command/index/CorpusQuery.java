@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dx.command.index;
+
+import com.android.dex.Dex;
+import com.android.dx.command.UsageException;
+import java.io.File;
+import java.io.IOException;
+import java.io.PrintWriter;
+import java.io.StringWriter;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+
+/**
+ * A query run over a corpus of dex files and reference indexes. Each input
+ * is queried in parallel; an index is used instead of its dex whenever it
+ * records the checksum and signature of the current dex. Results are
+ * printed in input order, each line prefixed with the input path when
+ * there is more than one input.
+ */
+public abstract class CorpusQuery {
+    /** name of the option selecting the number of query threads */
+    public static final String NUM_THREADS_OPTION = "--num-threads=";
+
+    /**
+     * Queries a dex file by decoding it.
+     *
+     * @return the number of matches found
+     */
+    protected abstract int query(Dex dex, PrintWriter out);
+
+    /**
+     * Queries a prebuilt index.
+     *
+     * @return the number of matches found
+     */
+    protected abstract int query(ReferenceIndex index, PrintWriter out);
+
+    /**
+     * Runs this query over {@code paths}, which are dex files, index files
+     * or directories searched recursively for both.
+     *
+     * @return the total number of matches found
+     */
+    public final int run(List<String> paths, int numThreads, PrintWriter out)
+            throws IOException {
+        final List<File> inputs = expandInputs(paths);
+        List<Future<String>> results = new ArrayList<Future<String>>(inputs.size());
+        ExecutorService pool = Executors.newFixedThreadPool(numThreads);
+        final int[] counts = new int[inputs.size()];
+        try {
+            for (int i = 0; i < inputs.size(); i++) {
+                final int input = i;
+                results.add(pool.submit(new Callable<String>() {
+                    @Override
+                    public String call() throws IOException {
+                        StringWriter buffer = new StringWriter();
+                        PrintWriter bufferOut = new PrintWriter(buffer);
+                        File file = inputs.get(input);
+                        if (file.getName().endsWith(ReferenceIndex.EXTENSION)) {
+                            counts[input] = query(ReferenceIndex.read(file), bufferOut);
+                        } else {
+                            counts[input] = query(new Dex(file), bufferOut);
+                        }
+                        bufferOut.flush();
+                        return buffer.toString();
+                    }
+                }));
+            }
+
+            int count = 0;
+            for (int i = 0; i < inputs.size(); i++) {
+                String result = get(results.get(i));
+                if (inputs.size() == 1) {
+                    out.print(result);
+                } else if (!result.isEmpty()) {
+                    String prefix = inputs.get(i).getPath() + ": ";
+                    for (String line : result.split("\r?\n")) {
+                        out.println(prefix + line);
+                    }
+                }
+                count += counts[i];
+            }
+            out.flush();
+            return count;
+        } finally {
+            pool.shutdownNow();
+        }
+    }
+
+    /**
+     * Parses the leading {@code --num-threads=<n>} option of {@code args},
+     * if any.
+     *
+     * @return the number of threads, or the number of available processors
+     * if the option is absent
+     * @throws UsageException if the number isn't a positive integer
+     */
+    public static int parseNumThreads(List<String> args) {
+        if (!args.isEmpty() && args.get(0).startsWith(NUM_THREADS_OPTION)) {
+            String value = args.remove(0).substring(NUM_THREADS_OPTION.length());
+            int result;
+            try {
+                result = Integer.parseInt(value);
+            } catch (NumberFormatException e) {
+                throw new UsageException();
+            }
+            if (result < 1) {
+                throw new UsageException();
+            }
+            return result;
+        }
+        return Runtime.getRuntime().availableProcessors();
+    }
+
+    /**
+     * Returns a mutable copy of {@code args}.
+     */
+    public static List<String> asList(String[] args) {
+        return new ArrayList<String>(Arrays.asList(args));
+    }
+
+    /**
+     * Expands directories and substitutes current indexes for dex files.
+     */
+    static List<File> expandInputs(List<String> paths) {
+        List<File> result = new ArrayList<File>();
+        for (String path : paths) {
+            File file = new File(path);
+            if (file.isDirectory()) {
+                collectDexFiles(file, result);
+            } else {
+                result.add(file);
+            }
+        }
+        for (int i = 0; i < result.size(); i++) {
+            File file = result.get(i);
+            if (!file.getName().endsWith(ReferenceIndex.EXTENSION)) {
+                File index = ReferenceIndex.indexFileFor(file);
+                if (index.isFile() && ReferenceIndex.isIndexOf(index, file)) {
+                    result.set(i, index);
+                }
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Adds the dex files found in {@code dir} and its subdirectories to
+     * {@code result}, and the index files that have no dex beside them.
+     */
+    static void collectDexFiles(File dir, List<File> result) {
+        File[] files = dir.listFiles();
+        if (files == null) {
+            return;
+        }
+        Arrays.sort(files);
+        for (File file : files) {
+            String name = file.getName();
+            if (file.isDirectory()) {
+                collectDexFiles(file, result);
+            } else if (name.endsWith(".dex")) {
+                result.add(file);
+            } else if (name.endsWith(ReferenceIndex.EXTENSION)) {
+                String dexName = name.substring(0,
+                        name.length() - ReferenceIndex.EXTENSION.length());
+                if (!new File(dir, dexName).isFile()) {
+                    result.add(file);
+                }
+            }
+        }
+    }
+
+    /**
+     * Waits for {@code future} and rethrows the exception of its task, if
+     * any, as it was thrown.
+     */
+    static <T> T get(Future<T> future) throws IOException {
+        try {
+            return future.get();
+        } catch (InterruptedException e) {
+            throw new IOException("Interrupted", e);
+        } catch (ExecutionException e) {
+            Throwable cause = e.getCause();
+            if (cause instanceof IOException) {
+                throw (IOException) cause;
+            } else if (cause instanceof RuntimeException) {
+                throw (RuntimeException) cause;
+            } else if (cause instanceof Error) {
+                throw (Error) cause;
+            }
+            throw new IOException(cause);
+        }
+    }
+}
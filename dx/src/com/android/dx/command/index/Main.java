@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dx.command.index;
+
+import com.android.dex.Dex;
+import com.android.dx.command.UsageException;
+import java.io.File;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+
+/**
+ * Builds the {@link ReferenceIndex} of dex files. The index of
+ * {@code foo.dex} is written beside it, as {@code foo.dex.refs}, where
+ * {@code --grep} and {@code --find-usages} will pick it up.
+ */
+public final class Main {
+    public static void main(String[] args) throws IOException {
+        List<String> paths = CorpusQuery.asList(args);
+        int numThreads = CorpusQuery.parseNumThreads(paths);
+        if (paths.isEmpty()) {
+            throw new UsageException();
+        }
+
+        List<File> dexFiles = new ArrayList<File>();
+        for (String path : paths) {
+            File file = new File(path);
+            if (file.isDirectory()) {
+                CorpusQuery.collectDexFiles(file, dexFiles);
+            } else {
+                dexFiles.add(file);
+            }
+        }
+
+        ExecutorService pool = Executors.newFixedThreadPool(numThreads);
+        try {
+            List<Future<Void>> futures = new ArrayList<Future<Void>>();
+            for (final File dexFile : dexFiles) {
+                if (dexFile.getName().endsWith(ReferenceIndex.EXTENSION)) {
+                    continue;
+                }
+                futures.add(pool.submit(new Callable<Void>() {
+                    @Override
+                    public Void call() throws IOException {
+                        ReferenceIndex.build(new Dex(dexFile))
+                                .writeTo(ReferenceIndex.indexFileFor(dexFile));
+                        return null;
+                    }
+                }));
+            }
+            for (Future<Void> future : futures) {
+                CorpusQuery.get(future);
+            }
+        } finally {
+            pool.shutdownNow();
+        }
+    }
+}
@@ -0,0 +1,878 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.dx.command.index;
+
+import com.android.dex.ClassData;
+import com.android.dex.ClassDef;
+import com.android.dex.Dex;
+import com.android.dex.DexException;
+import com.android.dex.DexFormat;
+import com.android.dex.EncodedValueReader;
+import com.android.dex.FieldId;
+import com.android.dex.Leb128;
+import com.android.dex.MethodId;
+import com.android.dex.Mutf8;
+import com.android.dex.ProtoId;
+import com.android.dex.util.ByteInput;
+import com.android.dex.util.FileUtils;
+import com.android.dx.io.CodeReader;
+import com.android.dx.io.OpcodeInfo;
+import com.android.dx.io.instructions.DecodedInstruction;
+import com.android.dx.util.ByteArrayAnnotatedOutput;
+import com.android.dx.util.IntList;
+import java.io.DataInputStream;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.io.PrintWriter;
+import java.io.RandomAccessFile;
+import java.io.UTFDataFormatException;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.List;
+import java.util.regex.Pattern;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipFile;
+
+/**
+ * Precomputed index of the references made by the code of a dex file. It
+ * is built in a single pass over the dex and records, for each string,
+ * type, field and method, the classes and methods that use it. Queries
+ * answered from the index print the same lines, in the same order, as
+ * {@link com.android.dx.command.grep.Grep} and
+ * {@link com.android.dx.command.findusages.FindUsages} do on the dex.
+ *
+ * <p>The index only keeps the tables of the dex that are needed to render
+ * query results: strings, type, field, method and proto ids, and the class
+ * hierarchy. Opening an index reads the id tables; strings are decoded
+ * when first used, and the reference postings of an item only when a
+ * query matches it. Queries still match their patterns against every
+ * string, as {@code Grep} and {@code FindUsages} do.</p>
+ *
+ * <p>The index starts with the checksum and signature of its dex, so that
+ * a stale index can be detected by reading two file headers.</p>
+ */
+public final class ReferenceIndex {
+    /** file name extension of index files */
+    public static final String EXTENSION = ".refs";
+
+    /** magic and format version at the start of index files */
+    private static final byte[] MAGIC = { 'd', 'x', 'r', 'e', 'f', '0', '2', 0 };
+
+    /** offset of the checksum and signature in a dex header */
+    private static final int DEX_ID_OFFSET = 8;
+
+    /** size of the checksum and signature in a dex header */
+    private static final int DEX_ID_SIZE = 24;
+
+    /** postings kind: strings used by code or static values */
+    private static final int STRING = 0;
+
+    /** postings kind: types used by code */
+    private static final int TYPE = 1;
+
+    /** postings kind: fields used by code */
+    private static final int FIELD = 2;
+
+    /** postings kind: methods invoked by code */
+    private static final int METHOD = 3;
+
+    /** postings kind: fields declared by classes */
+    private static final int FIELD_DECLARED = 4;
+
+    /** postings kind: methods declared by classes */
+    private static final int METHOD_DECLARED = 5;
+
+    private static final int KIND_COUNT = 6;
+
+    /** opcode of postings that don't come from an instruction */
+    private static final int NO_OPCODE = -1;
+
+    private final byte[] data;
+    private final StringTable strings;
+    private final int[] typeIds;
+    private final int[] fieldDeclaringTypes;
+    private final int[] fieldTypes;
+    private final int[] fieldNames;
+    private final StringTable protoParameters;
+    private final int[] methodDeclaringTypes;
+    private final int[] methodProtos;
+    private final int[] methodNames;
+    private final int[] classTypes;
+    private final int[] classSupertypes;
+    private final int[][] classInterfaces;
+    private final int[] locationTypes;
+    private final int[] locationMethods;
+    private final Postings[] postings;
+
+    /**
+     * Opens the index in {@code data}, as written by {@link #writeTo}.
+     */
+    private ReferenceIndex(byte[] data) {
+        if (data.length < MAGIC.length + DEX_ID_SIZE) {
+            throw new DexException("not a reference index");
+        }
+        for (int i = 0; i < MAGIC.length; i++) {
+            if (data[i] != MAGIC[i]) {
+                throw new DexException("not a reference index");
+            }
+        }
+
+        this.data = data;
+        Cursor in = new Cursor(data, MAGIC.length + DEX_ID_SIZE);
+        strings = new StringTable(in);
+        typeIds = in.readInts(in.readUleb());
+        int fieldCount = in.readUleb();
+        fieldDeclaringTypes = in.readInts(fieldCount);
+        fieldTypes = in.readInts(fieldCount);
+        fieldNames = in.readInts(fieldCount);
+        protoParameters = new StringTable(in);
+        int methodCount = in.readUleb();
+        methodDeclaringTypes = in.readInts(methodCount);
+        methodProtos = in.readInts(methodCount);
+        methodNames = in.readInts(methodCount);
+        int classCount = in.readUleb();
+        classTypes = in.readInts(classCount);
+        classSupertypes = new int[classCount];
+        classInterfaces = new int[classCount][];
+        for (int i = 0; i < classCount; i++) {
+            classSupertypes[i] = in.readUleb() - 1;
+            classInterfaces[i] = in.readInts(in.readUleb());
+        }
+        int locationCount = in.readUleb();
+        locationTypes = in.readInts(locationCount);
+        locationMethods = new int[locationCount];
+        for (int i = 0; i < locationCount; i++) {
+            locationMethods[i] = in.readUleb() - 1;
+        }
+        postings = new Postings[KIND_COUNT];
+        for (int kind = 0; kind < KIND_COUNT; kind++) {
+            postings[kind] = new Postings(in);
+        }
+    }
+
+    /**
+     * Returns the name of the index file of {@code dexFile}.
+     */
+    public static File indexFileFor(File dexFile) {
+        return new File(dexFile.getPath() + EXTENSION);
+    }
+
+    /**
+     * Builds the index of {@code dex}, decoding each method once.
+     */
+    public static ReferenceIndex build(Dex dex) {
+        return new ReferenceIndex(new Builder(dex).build());
+    }
+
+    /**
+     * Reads an index previously written by {@link #writeTo}.
+     */
+    public static ReferenceIndex read(File file) throws IOException {
+        try {
+            return new ReferenceIndex(FileUtils.readFile(file));
+        } catch (DexException e) {
+            throw new DexException(e.getMessage() + ": " + file);
+        }
+    }
+
+    /**
+     * Returns true if {@code index} is an index of the current content of
+     * {@code dexFile}: the checksum and signature it records match the
+     * header of the dex. Only the two headers are read.
+     */
+    public static boolean isIndexOf(File index, File dexFile) {
+        try {
+            byte[] indexHeader = new byte[MAGIC.length + DEX_ID_SIZE];
+            RandomAccessFile in = new RandomAccessFile(index, "r");
+            try {
+                in.readFully(indexHeader);
+            } finally {
+                in.close();
+            }
+            for (int i = 0; i < MAGIC.length; i++) {
+                if (indexHeader[i] != MAGIC[i]) {
+                    return false;
+                }
+            }
+            byte[] dexId = readDexId(dexFile);
+            for (int i = 0; i < DEX_ID_SIZE; i++) {
+                if (indexHeader[MAGIC.length + i] != dexId[i]) {
+                    return false;
+                }
+            }
+            return true;
+        } catch (IOException e) {
+            return false;
+        }
+    }
+
+    /**
+     * Reads the checksum and signature from the header of the dex in
+     * {@code dexFile}, which is a dex or an archive containing one.
+     */
+    private static byte[] readDexId(File dexFile) throws IOException {
+        byte[] result = new byte[DEX_ID_SIZE];
+        if (FileUtils.hasArchiveSuffix(dexFile.getName())) {
+            ZipFile zipFile = new ZipFile(dexFile);
+            try {
+                ZipEntry entry = zipFile.getEntry(DexFormat.DEX_IN_JAR_NAME);
+                if (entry == null) {
+                    throw new IOException("Expected " + DexFormat.DEX_IN_JAR_NAME
+                            + " in " + dexFile);
+                }
+                DataInputStream in = new DataInputStream(zipFile.getInputStream(entry));
+                try {
+                    in.readFully(new byte[DEX_ID_OFFSET]);
+                    in.readFully(result);
+                } finally {
+                    in.close();
+                }
+            } finally {
+                zipFile.close();
+            }
+        } else {
+            RandomAccessFile in = new RandomAccessFile(dexFile, "r");
+            try {
+                in.seek(DEX_ID_OFFSET);
+                in.readFully(result);
+            } finally {
+                in.close();
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Writes this index to {@code file}. The index is written under a
+     * temporary name then renamed, so that concurrent queries never see a
+     * partial file.
+     */
+    public void writeTo(File file) throws IOException {
+        File dir = file.getAbsoluteFile().getParentFile();
+        File tmp = File.createTempFile(file.getName(), ".tmp", dir);
+        try {
+            OutputStream fileOut = new FileOutputStream(tmp);
+            try {
+                fileOut.write(data);
+            } finally {
+                fileOut.close();
+            }
+            if (!tmp.renameTo(file)) {
+                // Some platforms can't rename over an existing file.
+                file.delete();
+                if (!tmp.renameTo(file)) {
+                    throw new IOException("Failed to rename " + tmp + " to " + file);
+                }
+            }
+            tmp = null;
+        } finally {
+            if (tmp != null) {
+                tmp.delete();
+            }
+        }
+    }
+
+    /**
+     * Prints the uses of strings matching {@code pattern} to {@code out},
+     * like {@link com.android.dx.command.grep.Grep#grep}.
+     *
+     * @return the number of matches found
+     */
+    public int grep(Pattern pattern, PrintWriter out) {
+        List<Hit> hits = new ArrayList<Hit>();
+        Postings p = postings[STRING];
+        Entries entries = new Entries();
+        for (int i = 0; i < strings.size(); i++) {
+            if (p.isEmpty(i)) {
+                continue;
+            }
+            String string = strings.get(i);
+            if (pattern.matcher(string).find()) {
+                p.read(i, entries);
+                for (int e = 0; e < entries.size(); e++) {
+                    hits.add(new Hit(entries.sequences.get(e),
+                            location(entries.locations.get(e)) + " " + string));
+                }
+            }
+        }
+        return print(hits, out);
+    }
+
+    /**
+     * Prints the declarations of and references to the members named
+     * {@code memberName} of types named {@code declaredBy} to {@code out},
+     * like {@link com.android.dx.command.findusages.FindUsages#findUsages}.
+     */
+    public void findUsages(String declaredBy, String memberName, PrintWriter out) {
+        IntList typeStringIndexes = new IntList();
+        boolean[] memberNameIndexes = new boolean[strings.size()];
+        boolean anyMemberName = false;
+        Pattern declaredByPattern = Pattern.compile(declaredBy);
+        Pattern memberNamePattern = Pattern.compile(memberName);
+        for (int i = 0; i < strings.size(); ++i) {
+            String string = strings.get(i);
+            if (declaredByPattern.matcher(string).matches()) {
+                typeStringIndexes.add(i);
+            }
+            if (memberNamePattern.matcher(string).matches()) {
+                memberNameIndexes[i] = true;
+                anyMemberName = true;
+            }
+        }
+        if (typeStringIndexes.size() == 0 || !anyMemberName) {
+            return; // these symbols are not mentioned in this dex
+        }
+
+        boolean[] methodIds = new boolean[methodNames.length];
+        boolean[] fieldIds = new boolean[fieldNames.length];
+        for (int t = 0; t < typeStringIndexes.size(); t++) {
+            int typeIndex = Arrays.binarySearch(typeIds, typeStringIndexes.get(t));
+            if (typeIndex < 0) {
+                continue; // this type name isn't used as a type in this dex
+            }
+            boolean[] subtypes = findAssignableTypes(typeIndex);
+            for (int m = 0; m < methodNames.length; m++) {
+                if (memberNameIndexes[methodNames[m]] && subtypes[methodDeclaringTypes[m]]) {
+                    methodIds[m] = true;
+                }
+            }
+            for (int f = 0; f < fieldNames.length; f++) {
+                if (memberNameIndexes[fieldNames[f]] && typeIndex == fieldDeclaringTypes[f]) {
+                    fieldIds[f] = true;
+                }
+            }
+        }
+
+        List<Hit> hits = new ArrayList<Hit>();
+        Entries entries = new Entries();
+        for (int f = 0; f < fieldIds.length; f++) {
+            if (!fieldIds[f]) {
+                continue;
+            }
+            postings[FIELD_DECLARED].read(f, entries);
+            for (int e = 0; e < entries.size(); e++) {
+                hits.add(new Hit(entries.sequences.get(e), location(entries.locations.get(e))
+                        + " field declared " + fieldToString(f)));
+            }
+            postings[FIELD].read(f, entries);
+            for (int e = 0; e < entries.size(); e++) {
+                hits.add(new Hit(entries.sequences.get(e), location(entries.locations.get(e))
+                        + ": field reference " + fieldToString(f)
+                        + " (" + OpcodeInfo.getName(entries.opcodes.get(e)) + ")"));
+            }
+        }
+        for (int m = 0; m < methodIds.length; m++) {
+            if (!methodIds[m]) {
+                continue;
+            }
+            postings[METHOD_DECLARED].read(m, entries);
+            for (int e = 0; e < entries.size(); e++) {
+                hits.add(new Hit(entries.sequences.get(e), location(entries.locations.get(e))
+                        + " method declared " + methodToString(m)));
+            }
+            postings[METHOD].read(m, entries);
+            for (int e = 0; e < entries.size(); e++) {
+                hits.add(new Hit(entries.sequences.get(e), location(entries.locations.get(e))
+                        + ": method reference " + methodToString(m)
+                        + " (" + OpcodeInfo.getName(entries.opcodes.get(e)) + ")"));
+            }
+        }
+        print(hits, out);
+    }
+
+    /**
+     * Returns the set of types that can be assigned to {@code typeIndex}.
+     */
+    private boolean[] findAssignableTypes(int typeIndex) {
+        boolean[] assignableTypes = new boolean[typeIds.length];
+        assignableTypes[typeIndex] = true;
+
+        for (int c = 0; c < classTypes.length; c++) {
+            int supertype = classSupertypes[c];
+            if (supertype != ClassDef.NO_INDEX && assignableTypes[supertype]) {
+                assignableTypes[classTypes[c]] = true;
+                continue;
+            }
+
+            for (int implemented : classInterfaces[c]) {
+                if (assignableTypes[implemented]) {
+                    assignableTypes[classTypes[c]] = true;
+                    break;
+                }
+            }
+        }
+
+        return assignableTypes;
+    }
+
+    private String typeName(int typeIndex) {
+        return strings.get(typeIds[typeIndex]);
+    }
+
+    private String location(int location) {
+        String className = typeName(locationTypes[location]);
+        int method = locationMethods[location];
+        if (method != -1) {
+            return className + "." + strings.get(methodNames[method]);
+        } else {
+            return className;
+        }
+    }
+
+    /** Same as {@link FieldId#toString}. */
+    private String fieldToString(int field) {
+        return typeName(fieldTypes[field]) + "." + strings.get(fieldNames[field]);
+    }
+
+    /** Same as {@link MethodId#toString}. */
+    private String methodToString(int method) {
+        return typeName(methodDeclaringTypes[method]) + "." + strings.get(methodNames[method])
+                + protoParameters.get(methodProtos[method]);
+    }
+
+    private static int print(List<Hit> hits, PrintWriter out) {
+        Collections.sort(hits);
+        for (Hit hit : hits) {
+            out.println(hit.line);
+        }
+        return hits.size();
+    }
+
+    /**
+     * A query result line, ordered like the dex traversal that found it.
+     */
+    private static final class Hit implements Comparable<Hit> {
+        private final int sequence;
+        private final String line;
+
+        Hit(int sequence, String line) {
+            this.sequence = sequence;
+            this.line = line;
+        }
+
+        @Override
+        public int compareTo(Hit other) {
+            return sequence < other.sequence ? -1 : (sequence == other.sequence ? 0 : 1);
+        }
+    }
+
+    /**
+     * Reads index data from a position of a byte array.
+     */
+    private static final class Cursor implements ByteInput {
+        private final byte[] data;
+        int position;
+
+        Cursor(byte[] data, int position) {
+            this.data = data;
+            this.position = position;
+        }
+
+        @Override
+        public byte readByte() {
+            return data[position++];
+        }
+
+        int readUleb() {
+            return Leb128.readUnsignedLeb128(this);
+        }
+
+        int[] readInts(int count) {
+            int[] result = new int[count];
+            for (int i = 0; i < count; i++) {
+                result[i] = readUleb();
+            }
+            return result;
+        }
+
+        /**
+         * Returns the little-endian int at {@code offset}, which is
+         * independent of the position.
+         */
+        int intAt(int offset) {
+            return (data[offset] & 0xff)
+                    | ((data[offset + 1] & 0xff) << 8)
+                    | ((data[offset + 2] & 0xff) << 16)
+                    | ((data[offset + 3] & 0xff) << 24);
+        }
+    }
+
+    /**
+     * Table of strings encoded as in a dex, with a table of offsets so
+     * that each string is decoded on first use only.
+     */
+    private static final class StringTable {
+        private final byte[] data;
+        private final int offsetsStart;
+        private final int dataStart;
+        private final String[] decoded;
+
+        /**
+         * Opens the table at the position of {@code in}, and moves
+         * {@code in} past it.
+         */
+        StringTable(Cursor in) {
+            this.data = in.data;
+            int size = in.readUleb();
+            this.offsetsStart = in.position;
+            this.dataStart = offsetsStart + (size + 1) * 4;
+            this.decoded = new String[size];
+            in.position = dataStart + in.intAt(offsetsStart + size * 4);
+        }
+
+        int size() {
+            return decoded.length;
+        }
+
+        String get(int index) {
+            String result = decoded[index];
+            if (result == null) {
+                Cursor in = new Cursor(data, 0);
+                in.position = dataStart + in.intAt(offsetsStart + index * 4);
+                try {
+                    result = Mutf8.decode(in, new char[in.readUleb()]);
+                } catch (UTFDataFormatException e) {
+                    throw new DexException(e);
+                }
+                decoded[index] = result;
+            }
+            return result;
+        }
+
+        static void write(ByteArrayAnnotatedOutput out, String[] values)
+                throws UTFDataFormatException {
+            ByteArrayAnnotatedOutput encoded = new ByteArrayAnnotatedOutput();
+            out.writeUleb128(values.length);
+            for (String s : values) {
+                out.writeInt(encoded.getCursor());
+                encoded.writeUleb128(s.length());
+                encoded.write(Mutf8.encode(s));
+                encoded.writeByte(0);
+            }
+            out.writeInt(encoded.getCursor());
+            out.write(encoded.getArray(), 0, encoded.getCursor());
+        }
+    }
+
+    /**
+     * Decoded postings of one item.
+     */
+    private static final class Entries {
+        /** traversal sequence number of each entry */
+        final IntList sequences = new IntList();
+
+        /** location of each entry */
+        final IntList locations = new IntList();
+
+        /** opcode of each entry, or {@link #NO_OPCODE} */
+        final IntList opcodes = new IntList();
+
+        int size() {
+            return sequences.size();
+        }
+
+        void clear() {
+            sequences.shrink(0);
+            locations.shrink(0);
+            opcodes.shrink(0);
+        }
+    }
+
+    /**
+     * Posting lists of one kind of reference, indexed by the referenced
+     * item. A table of offsets locates the entries of each item, which
+     * are in dex traversal order and only decoded by {@link #read}.
+     */
+    private static final class Postings {
+        private final byte[] data;
+        private final int offsetsStart;
+        private final int entriesStart;
+
+        /**
+         * Opens the postings at the position of {@code in}, and moves
+         * {@code in} past them.
+         */
+        Postings(Cursor in) {
+            this.data = in.data;
+            int itemCount = in.readUleb();
+            this.offsetsStart = in.position;
+            this.entriesStart = offsetsStart + (itemCount + 1) * 4;
+            in.position = entriesStart + in.intAt(offsetsStart + itemCount * 4);
+        }
+
+        boolean isEmpty(int item) {
+            Cursor in = new Cursor(data, 0);
+            return in.intAt(offsetsStart + item * 4) == in.intAt(offsetsStart + item * 4 + 4);
+        }
+
+        /**
+         * Decodes the entries of {@code item} into {@code entries}.
+         */
+        void read(int item, Entries entries) {
+            entries.clear();
+            Cursor in = new Cursor(data, 0);
+            int end = entriesStart + in.intAt(offsetsStart + item * 4 + 4);
+            in.position = entriesStart + in.intAt(offsetsStart + item * 4);
+            int sequence = 0;
+            while (in.position < end) {
+                sequence += in.readUleb();
+                entries.sequences.add(sequence);
+                entries.locations.add(in.readUleb());
+                entries.opcodes.add(in.readUleb() - 1);
+            }
+        }
+
+        /**
+         * Groups entries recorded in traversal order by item, and writes
+         * them. The sort is stable, so the entries of each item stay in
+         * traversal order.
+         */
+        static void write(ByteArrayAnnotatedOutput out, int itemCount, IntList items,
+                IntList sequences, IntList locations, IntList opcodes) {
+            int entryCount = items.size();
+            int[] starts = new int[itemCount + 1];
+            for (int e = 0; e < entryCount; e++) {
+                starts[items.get(e) + 1]++;
+            }
+            for (int i = 0; i < itemCount; i++) {
+                starts[i + 1] += starts[i];
+            }
+            int[] next = starts.clone();
+            int[] sorted = new int[entryCount];
+            for (int e = 0; e < entryCount; e++) {
+                sorted[next[items.get(e)]++] = e;
+            }
+
+            ByteArrayAnnotatedOutput encoded = new ByteArrayAnnotatedOutput();
+            out.writeUleb128(itemCount);
+            for (int i = 0; i < itemCount; i++) {
+                out.writeInt(encoded.getCursor());
+                int sequence = 0;
+                for (int s = starts[i]; s < starts[i + 1]; s++) {
+                    int e = sorted[s];
+                    encoded.writeUleb128(sequences.get(e) - sequence);
+                    sequence = sequences.get(e);
+                    encoded.writeUleb128(locations.get(e));
+                    encoded.writeUleb128(opcodes.get(e) + 1);
+                }
+            }
+            out.writeInt(encoded.getCursor());
+            out.write(encoded.getArray(), 0, encoded.getCursor());
+        }
+    }
+
+    /**
+     * Builds an index in one traversal of a dex. The traversal visits the
+     * same items in the same order as {@code Grep} and {@code FindUsages}.
+     */
+    private static final class Builder {
+        private final Dex dex;
+        private final CodeReader codeReader = new CodeReader();
+        private final IntList[] items = new IntList[KIND_COUNT];
+        private final IntList[] sequences = new IntList[KIND_COUNT];
+        private final IntList[] locations = new IntList[KIND_COUNT];
+        private final IntList[] opcodes = new IntList[KIND_COUNT];
+        private final IntList locationTypes = new IntList();
+        private final IntList locationMethods = new IntList();
+        private int sequence = 0;
+        private int location = -1;
+
+        Builder(Dex dex) {
+            this.dex = dex;
+            for (int kind = 0; kind < KIND_COUNT; kind++) {
+                items[kind] = new IntList();
+                sequences[kind] = new IntList();
+                locations[kind] = new IntList();
+                opcodes[kind] = new IntList();
+            }
+            codeReader.setStringVisitor(new Recorder(STRING));
+            codeReader.setTypeVisitor(new Recorder(TYPE));
+            codeReader.setFieldVisitor(new Recorder(FIELD));
+            codeReader.setMethodVisitor(new Recorder(METHOD));
+        }
+
+        /**
+         * Returns the index data, as written to index files.
+         */
+        byte[] build() {
+            for (ClassDef classDef : dex.classDefs()) {
+                if (classDef.getClassDataOffset() == 0) {
+                    continue;
+                }
+                enterLocation(classDef.getTypeIndex(), -1);
+
+                ClassData classData = dex.readClassData(classDef);
+                for (ClassData.Field field : classData.allFields()) {
+                    record(FIELD_DECLARED, field.getFieldIndex(), NO_OPCODE);
+                }
+
+                int staticValuesOffset = classDef.getStaticValuesOffset();
+                if (staticValuesOffset != 0) {
+                    readArray(new EncodedValueReader(dex.open(staticValuesOffset)));
+                }
+
+                for (ClassData.Method method : classData.allMethods()) {
+                    enterLocation(classDef.getTypeIndex(), method.getMethodIndex());
+                    record(METHOD_DECLARED, method.getMethodIndex(), NO_OPCODE);
+                    if (method.getCodeOffset() != 0) {
+                        codeReader.visitAll(dex.readCode(method).getInstructions());
+                    }
+                }
+            }
+
+            ByteArrayAnnotatedOutput out = new ByteArrayAnnotatedOutput();
+            out.write(MAGIC);
+            out.write(dex.open(DEX_ID_OFFSET).readByteArray(DEX_ID_SIZE));
+
+            List<String> strings = dex.strings();
+            try {
+                StringTable.write(out, strings.toArray(new String[strings.size()]));
+            } catch (UTFDataFormatException e) {
+                throw new DexException(e);
+            }
+
+            List<Integer> typeIds = dex.typeIds();
+            out.writeUleb128(typeIds.size());
+            for (int typeId : typeIds) {
+                out.writeUleb128(typeId);
+            }
+
+            List<FieldId> fieldIds = dex.fieldIds();
+            out.writeUleb128(fieldIds.size());
+            for (FieldId fieldId : fieldIds) {
+                out.writeUleb128(fieldId.getDeclaringClassIndex());
+            }
+            for (FieldId fieldId : fieldIds) {
+                out.writeUleb128(fieldId.getTypeIndex());
+            }
+            for (FieldId fieldId : fieldIds) {
+                out.writeUleb128(fieldId.getNameIndex());
+            }
+
+            List<ProtoId> protoIds = dex.protoIds();
+            String[] protoParameters = new String[protoIds.size()];
+            for (int i = 0; i < protoParameters.length; i++) {
+                protoParameters[i] =
+                        dex.readTypeList(protoIds.get(i).getParametersOffset()).toString();
+            }
+            try {
+                StringTable.write(out, protoParameters);
+            } catch (UTFDataFormatException e) {
+                throw new DexException(e);
+            }
+
+            List<MethodId> methodIds = dex.methodIds();
+            out.writeUleb128(methodIds.size());
+            for (MethodId methodId : methodIds) {
+                out.writeUleb128(methodId.getDeclaringClassIndex());
+            }
+            for (MethodId methodId : methodIds) {
+                out.writeUleb128(methodId.getProtoIndex());
+            }
+            for (MethodId methodId : methodIds) {
+                out.writeUleb128(methodId.getNameIndex());
+            }
+
+            List<ClassDef> classDefs = new ArrayList<ClassDef>();
+            for (ClassDef classDef : dex.classDefs()) {
+                classDefs.add(classDef);
+            }
+            out.writeUleb128(classDefs.size());
+            for (ClassDef classDef : classDefs) {
+                out.writeUleb128(classDef.getTypeIndex());
+            }
+            for (ClassDef classDef : classDefs) {
+                out.writeUleb128(classDef.getSupertypeIndex() + 1);
+                short[] interfaces = classDef.getInterfaces();
+                out.writeUleb128(interfaces.length);
+                for (short implemented : interfaces) {
+                    out.writeUleb128(implemented & 0xffff);
+                }
+            }
+
+            out.writeUleb128(locationTypes.size());
+            for (int i = 0; i < locationTypes.size(); i++) {
+                out.writeUleb128(locationTypes.get(i));
+            }
+            for (int i = 0; i < locationMethods.size(); i++) {
+                out.writeUleb128(locationMethods.get(i) + 1);
+            }
+
+            int[] itemCounts = new int[KIND_COUNT];
+            itemCounts[STRING] = strings.size();
+            itemCounts[TYPE] = typeIds.size();
+            itemCounts[FIELD] = fieldIds.size();
+            itemCounts[METHOD] = methodIds.size();
+            itemCounts[FIELD_DECLARED] = fieldIds.size();
+            itemCounts[METHOD_DECLARED] = methodIds.size();
+            for (int kind = 0; kind < KIND_COUNT; kind++) {
+                Postings.write(out, itemCounts[kind], items[kind], sequences[kind],
+                        locations[kind], opcodes[kind]);
+            }
+
+            return out.toByteArray();
+        }
+
+        private void enterLocation(int typeIndex, int methodIndex) {
+            location = locationTypes.size();
+            locationTypes.add(typeIndex);
+            locationMethods.add(methodIndex);
+        }
+
+        private void record(int kind, int item, int opcode) {
+            items[kind].add(item);
+            sequences[kind].add(sequence++);
+            locations[kind].add(location);
+            opcodes[kind].add(opcode);
+        }
+
+        private void readArray(EncodedValueReader reader) {
+            for (int i = 0, size = reader.readArray(); i < size; i++) {
+                switch (reader.peek()) {
+                case EncodedValueReader.ENCODED_STRING:
+                    record(STRING, reader.readString(), NO_OPCODE);
+                    break;
+                case EncodedValueReader.ENCODED_ARRAY:
+                    readArray(reader);
+                    break;
+                default:
+                    reader.skipValue();
+                    break;
+                }
+            }
+        }
+
+        /**
+         * Records the instructions referring to one kind of item.
+         */
+        private final class Recorder implements CodeReader.Visitor {
+            private final int kind;
+
+            Recorder(int kind) {
+                this.kind = kind;
+            }
+
+            @Override
+            public void visit(DecodedInstruction[] all, DecodedInstruction one) {
+                record(kind, one.getIndex(), one.getOpcode());
+            }
+        }
+    }
+}
@@ -29,6 +29,7 @@ import com.android.dex.MethodHandle;
 import com.android.dex.MethodId;
 import com.android.dex.ProtoId;
 import com.android.dex.SizeOf;
+import com.android.dex.StringIndex;
 import com.android.dex.TableOfContents;
 import com.android.dex.TypeList;
 import com.android.dx.command.dexer.DxContext;
@@ -388,26 +389,62 @@ public final class DexMerger {
         return maxApi;
     }
 
+    /**
+     * Merges the string tables with a k-way merge over the encoded strings,
+     * so that strings are neither decoded nor re-encoded. The queue holds
+     * the index of each dex that has strings left, ordered by its current
+     * string.
+     */
     private void mergeStringIds() {
-        new IdMerger<String>(idsDefsOut) {
-            @Override TableOfContents.Section getSection(TableOfContents tableOfContents) {
-                return tableOfContents.stringIds;
+        final StringIndex[] strings = new StringIndex[dexes.length];
+        final int[] indexes = new int[dexes.length];
+        PriorityQueue<Integer> queue = new PriorityQueue<Integer>(
+                Math.max(1, dexes.length), new Comparator<Integer>() {
+            @Override public int compare(Integer a, Integer b) {
+                int result = strings[a].compare(indexes[a], strings[b], indexes[b]);
+                return result != 0 ? result : a - b;
             }
-
-            @Override String read(Dex.Section in, IndexMap indexMap, int index) {
-                return in.readString();
+        });
+        for (int i = 0; i < dexes.length; i++) {
+            strings[i] = dexes[i].stringIndex();
+            if (strings[i].size() > 0) {
+                queue.add(i);
             }
-
-            @Override void updateIndex(int offset, IndexMap indexMap, int oldIndex, int newIndex) {
-                indexMap.stringIds[oldIndex] = newIndex;
+        }
+        if (queue.isEmpty()) {
+            contentsOut.stringIds.off = 0;
+            contentsOut.stringIds.size = 0;
+            return;
+        }
+        contentsOut.stringIds.off = idsDefsOut.getPosition();
+
+        int outCount = 0;
+        while (!queue.isEmpty()) {
+            int first = queue.poll();
+            StringIndex firstStrings = strings[first];
+            int firstIndex = indexes[first];
+            contentsOut.stringDatas.size++;
+            idsDefsOut.writeInt(stringDataOut.getPosition());
+            stringDataOut.writeStringData(firstStrings, firstIndex);
+
+            // advance every dex whose current string is the one just written
+            int dex = first;
+            while (true) {
+                indexMaps[dex].stringIds[indexes[dex]++] = outCount;
+                if (indexes[dex] < strings[dex].size()) {
+                    queue.add(dex);
+                }
+                Integer next = queue.peek();
+                if (next == null
+                        || !firstStrings.sameString(firstIndex, strings[next], indexes[next])) {
+                    break;
+                }
+                dex = queue.poll();
             }
+            outCount++;
+        }
 
-            @Override void write(String value) {
-                contentsOut.stringDatas.size++;
-                idsDefsOut.writeInt(stringDataOut.getPosition());
-                stringDataOut.writeStringData(value);
-            }
-        }.mergeSorted();
+        contentsOut.stringIds.size = outCount;
     }
 
     private void mergeTypeIds() {
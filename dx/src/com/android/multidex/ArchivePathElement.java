@@ -16,6 +16,7 @@
 
 package com.android.multidex;
 
+import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.io.InputStream;
@@ -51,6 +52,13 @@ class ArchivePathElement implements ClassPathElement {
         }
     }
 
+    /**
+     * Returns the archive file this element was opened from.
+     */
+    File getFile() {
+        return new File(archive.getName());
+    }
+
     @Override
     public void close() throws IOException {
         archive.close();
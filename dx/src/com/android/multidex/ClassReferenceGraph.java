@@ -0,0 +1,700 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.android.multidex;
+
+import com.android.dx.cf.attrib.AttRuntimeVisibleAnnotations;
+import com.android.dx.cf.direct.DirectClassFile;
+import com.android.dx.cf.direct.StdAttributeFactory;
+import com.android.dx.cf.iface.Attribute;
+import com.android.dx.cf.iface.FieldList;
+import com.android.dx.cf.iface.HasAttribute;
+import com.android.dx.cf.iface.MethodList;
+import com.android.dx.rop.cst.Constant;
+import com.android.dx.rop.cst.CstBaseMethodRef;
+import com.android.dx.rop.cst.CstFieldRef;
+import com.android.dx.rop.cst.CstType;
+import com.android.dx.rop.type.Prototype;
+import com.android.dx.rop.type.StdTypeList;
+import com.android.dx.rop.type.TypeList;
+import com.android.dx.util.Bits;
+import com.android.dx.util.IntList;
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.LinkedHashSet;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+
+/**
+ * Class reference graph of a {@link Path}. Each class found in the path is
+ * a node, identified by a dense {@code int} id, with two kinds of outgoing
+ * edges: its direct hierarchy (superclass and interfaces) and the classes
+ * it directly references from its constant pool, fields and methods.
+ * Edges pointing outside of the path are dropped.
+ *
+ * <p>Class files are parsed in parallel. When a cache directory is given,
+ * the graph of each archive of the path is stored there under the SHA-1 of
+ * the archive content, so that an unchanged archive is never parsed
+ * again.</p>
+ */
+final class ClassReferenceGraph {
+    private static final String CLASS_EXTENSION = ".class";
+
+    private static final String CACHE_EXTENSION = ".graph";
+
+    /** magic number at the start of cache files: {@code "mdg"} plus format version */
+    private static final int CACHE_MAGIC = 0x6d646701;
+
+    /** {@code non-null;} class names, indexed by id */
+    private final String[] names;
+
+    /** {@code non-null;} class ids, keyed by class name */
+    private final Map<String, Integer> ids;
+
+    /** {@code non-null;} bit set of classes with runtime visible annotations */
+    private final int[] annotated;
+
+    /** {@code non-null;} start of each class hierarchy in {@link #hierarchyEdges} */
+    private final int[] hierarchyStarts;
+
+    /** {@code non-null;} concatenated hierarchy edges of all classes */
+    private final int[] hierarchyEdges;
+
+    /** {@code non-null;} start of each class references in {@link #referenceEdges} */
+    private final int[] referenceStarts;
+
+    /** {@code non-null;} concatenated reference edges of all classes */
+    private final int[] referenceEdges;
+
+    private ClassReferenceGraph(String[] names, Map<String, Integer> ids, int[] annotated,
+            int[] hierarchyStarts, int[] hierarchyEdges,
+            int[] referenceStarts, int[] referenceEdges) {
+        this.names = names;
+        this.ids = ids;
+        this.annotated = annotated;
+        this.hierarchyStarts = hierarchyStarts;
+        this.hierarchyEdges = hierarchyEdges;
+        this.referenceStarts = referenceStarts;
+        this.referenceEdges = referenceEdges;
+    }
+
+    /**
+     * Builds the graph of all classes in {@code path}. When a class is
+     * present in several elements, the first one wins, as it does
+     * at run time.
+     *
+     * @param path {@code non-null;} the class path to index
+     * @param cacheDir {@code null-ok;} directory where archive graphs are
+     * cached, or {@code null} to always parse
+     * @param numThreads {@code > 0;} number of parsing threads
+     */
+    static ClassReferenceGraph build(Path path, File cacheDir, int numThreads)
+            throws IOException {
+        List<ClassPathElement> elements = path.elements;
+        ElementGraph[] graphs = new ElementGraph[elements.size()];
+        String[] cacheKeys = new String[graphs.length];
+        List<List<Future<ClassNode>>> pending =
+                new ArrayList<List<Future<ClassNode>>>(graphs.length);
+
+        ExecutorService pool = Executors.newFixedThreadPool(numThreads);
+        try {
+            for (int i = 0; i < graphs.length; i++) {
+                ClassPathElement element = elements.get(i);
+                List<Future<ClassNode>> futures = null;
+                if (cacheDir != null && element instanceof ArchivePathElement) {
+                    cacheKeys[i] = hash(((ArchivePathElement) element).getFile());
+                    graphs[i] = ElementGraph.readCache(cacheFile(cacheDir, cacheKeys[i]));
+                }
+                if (graphs[i] == null) {
+                    futures = new ArrayList<Future<ClassNode>>();
+                    for (String name : element.list()) {
+                        if (name.endsWith(CLASS_EXTENSION)) {
+                            futures.add(pool.submit(new ClassParser(element, name)));
+                        }
+                    }
+                }
+                pending.add(futures);
+            }
+
+            for (int i = 0; i < graphs.length; i++) {
+                List<Future<ClassNode>> futures = pending.get(i);
+                if (futures == null) {
+                    continue;
+                }
+                List<ClassNode> nodes = new ArrayList<ClassNode>(futures.size());
+                for (Future<ClassNode> future : futures) {
+                    nodes.add(get(future));
+                }
+                graphs[i] = new ElementGraph(nodes);
+                if (cacheKeys[i] != null) {
+                    graphs[i].writeCache(cacheDir, cacheFile(cacheDir, cacheKeys[i]));
+                }
+            }
+        } finally {
+            pool.shutdownNow();
+        }
+
+        return link(graphs);
+    }
+
+    /**
+     * Merges the graphs of all path elements, resolving class names to
+     * global ids.
+     */
+    private static ClassReferenceGraph link(ElementGraph[] graphs) {
+        Map<String, Integer> ids = new HashMap<String, Integer>();
+        List<ElementGraph> owners = new ArrayList<ElementGraph>();
+        IntList locals = new IntList();
+        for (ElementGraph graph : graphs) {
+            for (int i = 0; i < graph.classCount; i++) {
+                String name = graph.names[i];
+                if (!ids.containsKey(name)) {
+                    ids.put(name, Integer.valueOf(owners.size()));
+                    owners.add(graph);
+                    locals.add(i);
+                }
+            }
+        }
+
+        int count = owners.size();
+        String[] names = new String[count];
+        int[] annotated = Bits.makeBitSet(count);
+        int[] hierarchyStarts = new int[count + 1];
+        int[] referenceStarts = new int[count + 1];
+        IntList hierarchyEdges = new IntList();
+        IntList referenceEdges = new IntList();
+        for (int id = 0; id < count; id++) {
+            ElementGraph graph = owners.get(id);
+            int local = locals.get(id);
+            names[id] = graph.names[local];
+            if (Bits.get(graph.annotated, local)) {
+                Bits.set(annotated, id);
+            }
+            hierarchyStarts[id] = hierarchyEdges.size();
+            resolve(graph, graph.hierarchy[local], ids, hierarchyEdges);
+            referenceStarts[id] = referenceEdges.size();
+            resolve(graph, graph.references[local], ids, referenceEdges);
+        }
+        hierarchyStarts[count] = hierarchyEdges.size();
+        referenceStarts[count] = referenceEdges.size();
+
+        return new ClassReferenceGraph(names, ids, annotated,
+                hierarchyStarts, toArray(hierarchyEdges),
+                referenceStarts, toArray(referenceEdges));
+    }
+
+    private static void resolve(ElementGraph graph, int[] localEdges, Map<String, Integer> ids,
+            IntList out) {
+        for (int local : localEdges) {
+            Integer id = ids.get(graph.names[local]);
+            if (id != null) {
+                out.add(id.intValue());
+            }
+        }
+    }
+
+    private static int[] toArray(IntList list) {
+        int[] result = new int[list.size()];
+        for (int i = 0; i < result.length; i++) {
+            result[i] = list.get(i);
+        }
+        return result;
+    }
+
+    private static ClassNode get(Future<ClassNode> future) throws IOException {
+        try {
+            return future.get();
+        } catch (InterruptedException e) {
+            throw new IOException("Interrupted while parsing class path", e);
+        } catch (ExecutionException e) {
+            Throwable cause = e.getCause();
+            if (cause instanceof IOException) {
+                throw (IOException) cause;
+            } else if (cause instanceof RuntimeException) {
+                throw (RuntimeException) cause;
+            } else if (cause instanceof Error) {
+                throw (Error) cause;
+            }
+            throw new IOException(cause);
+        }
+    }
+
+    private static File cacheFile(File cacheDir, String key) {
+        return new File(cacheDir, key + CACHE_EXTENSION);
+    }
+
+    /**
+     * Returns the SHA-1 of the content of {@code file} as a hex string.
+     */
+    private static String hash(File file) throws IOException {
+        MessageDigest digest;
+        try {
+            digest = MessageDigest.getInstance("SHA-1");
+        } catch (NoSuchAlgorithmException e) {
+            throw new AssertionError(e);
+        }
+        byte[] buffer = new byte[64 * 1024];
+        InputStream in = new FileInputStream(file);
+        try {
+            for (;;) {
+                int amt = in.read(buffer);
+                if (amt < 0) {
+                    break;
+                }
+                digest.update(buffer, 0, amt);
+            }
+        } finally {
+            in.close();
+        }
+        StringBuilder sb = new StringBuilder(40);
+        for (byte b : digest.digest()) {
+            sb.append(Character.forDigit((b >> 4) & 0xf, 16));
+            sb.append(Character.forDigit(b & 0xf, 16));
+        }
+        return sb.toString();
+    }
+
+    /**
+     * Gets the number of classes in the graph.
+     */
+    int getClassCount() {
+        return names.length;
+    }
+
+    /**
+     * Gets the id of the named class.
+     *
+     * @param className {@code non-null;} internal name of the class, eg.
+     * {@code java/lang/Object}
+     * @return the id of the class, or {@code -1} if it isn't in the path
+     */
+    int getId(String className) {
+        Integer id = ids.get(className);
+        return id == null ? -1 : id.intValue();
+    }
+
+    /**
+     * Gets the internal name of the class with the given id.
+     */
+    String getClassName(int id) {
+        return names[id];
+    }
+
+    /**
+     * Returns whether the class, one of its fields or one of its methods
+     * has runtime visible annotations.
+     */
+    boolean hasRuntimeVisibleAnnotation(int id) {
+        return Bits.get(annotated, id);
+    }
+
+    /** Gets the start in {@link #getHierarchyEdges} of the hierarchy of {@code id}. */
+    int getHierarchyStart(int id) {
+        return hierarchyStarts[id];
+    }
+
+    /** Gets the end in {@link #getHierarchyEdges} of the hierarchy of {@code id}. */
+    int getHierarchyEnd(int id) {
+        return hierarchyStarts[id + 1];
+    }
+
+    /**
+     * Gets the concatenated superclass and interface ids of all classes.
+     * Callers must not modify the returned array.
+     */
+    int[] getHierarchyEdges() {
+        return hierarchyEdges;
+    }
+
+    /** Gets the start in {@link #getReferenceEdges} of the references of {@code id}. */
+    int getReferenceStart(int id) {
+        return referenceStarts[id];
+    }
+
+    /** Gets the end in {@link #getReferenceEdges} of the references of {@code id}. */
+    int getReferenceEnd(int id) {
+        return referenceStarts[id + 1];
+    }
+
+    /**
+     * Gets the concatenated directly referenced class ids of all classes.
+     * Callers must not modify the returned array.
+     */
+    int[] getReferenceEdges() {
+        return referenceEdges;
+    }
+
+    /**
+     * Edges of a single class file, by class name.
+     */
+    private static final class ClassNode {
+        final String name;
+        final boolean annotated;
+        final Set<String> hierarchy = new LinkedHashSet<String>();
+        final Set<String> references = new LinkedHashSet<String>();
+
+        ClassNode(String name, boolean annotated) {
+            this.name = name;
+            this.annotated = annotated;
+        }
+    }
+
+    /**
+     * Reads and parses one class file of a path element.
+     */
+    private static final class ClassParser implements Callable<ClassNode> {
+        /** buffers of each parsing thread, reused across class files */
+        private static final ThreadLocal<ByteArrayOutputStream> OUTPUTS =
+                new ThreadLocal<ByteArrayOutputStream>() {
+            @Override
+            protected ByteArrayOutputStream initialValue() {
+                return new ByteArrayOutputStream(40 * 1024);
+            }
+        };
+        private static final ThreadLocal<byte[]> READ_BUFFERS = new ThreadLocal<byte[]>() {
+            @Override
+            protected byte[] initialValue() {
+                return new byte[20 * 1024];
+            }
+        };
+
+        private final ClassPathElement element;
+        private final String entryName;
+
+        ClassParser(ClassPathElement element, String entryName) {
+            this.element = element;
+            this.entryName = entryName;
+        }
+
+        @Override
+        public ClassNode call() throws IOException {
+            ByteArrayOutputStream out = OUTPUTS.get();
+            out.reset();
+            byte[] bytes = Path.readStream(element.open(entryName), out, READ_BUFFERS.get());
+            DirectClassFile classFile = new DirectClassFile(bytes, entryName, false);
+            classFile.setAttributeFactory(StdAttributeFactory.THE_ONE);
+
+            String name = entryName;
+            if (name.charAt(0) == ClassPathElement.SEPARATOR_CHAR) {
+                name = name.substring(1);
+            }
+            name = name.substring(0, name.length() - CLASS_EXTENSION.length());
+            ClassNode node = new ClassNode(name, isAnnotated(classFile));
+
+            CstType superClass = classFile.getSuperclass();
+            if (superClass != null) {
+                node.hierarchy.add(superClass.getClassType().getClassName());
+            }
+            TypeList interfaceList = classFile.getInterfaces();
+            int interfaceNumber = interfaceList.size();
+            for (int i = 0; i < interfaceNumber; i++) {
+                node.hierarchy.add(interfaceList.getType(i).getClassName());
+            }
+
+            for (Constant constant : classFile.getConstantPool().getEntries()) {
+                if (constant instanceof CstType) {
+                    checkDescriptor(node, ((CstType) constant).getClassType().getDescriptor());
+                } else if (constant instanceof CstFieldRef) {
+                    checkDescriptor(node, ((CstFieldRef) constant).getType().getDescriptor());
+                } else if (constant instanceof CstBaseMethodRef) {
+                    checkPrototype(node, ((CstBaseMethodRef) constant).getPrototype());
+                }
+            }
+
+            FieldList fields = classFile.getFields();
+            int nbField = fields.size();
+            for (int i = 0; i < nbField; i++) {
+                checkDescriptor(node, fields.get(i).getDescriptor().getString());
+            }
+
+            MethodList methods = classFile.getMethods();
+            int nbMethods = methods.size();
+            for (int i = 0; i < nbMethods; i++) {
+                checkPrototype(node,
+                        Prototype.intern(methods.get(i).getDescriptor().getString()));
+            }
+            return node;
+        }
+
+        private static boolean isAnnotated(DirectClassFile classFile) {
+            if (hasRuntimeVisibleAnnotation(classFile)) {
+                return true;
+            }
+            MethodList methods = classFile.getMethods();
+            for (int i = 0; i < methods.size(); i++) {
+                if (hasRuntimeVisibleAnnotation(methods.get(i))) {
+                    return true;
+                }
+            }
+            FieldList fields = classFile.getFields();
+            for (int i = 0; i < fields.size(); i++) {
+                if (hasRuntimeVisibleAnnotation(fields.get(i))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        private static boolean hasRuntimeVisibleAnnotation(HasAttribute element) {
+            Attribute att = element.getAttributes().findFirst(
+                    AttRuntimeVisibleAnnotations.ATTRIBUTE_NAME);
+            return (att != null
+                    && ((AttRuntimeVisibleAnnotations) att).getAnnotations().size() > 0);
+        }
+
+        private static void checkPrototype(ClassNode node, Prototype proto) {
+            checkDescriptor(node, proto.getReturnType().getDescriptor());
+            StdTypeList args = proto.getParameterTypes();
+            for (int i = 0; i < args.size(); i++) {
+                checkDescriptor(node, args.get(i).getDescriptor());
+            }
+        }
+
+        private static void checkDescriptor(ClassNode node, String typeDescriptor) {
+            if (typeDescriptor.endsWith(";")) {
+                int lastBrace = typeDescriptor.lastIndexOf('[');
+                if (lastBrace < 0) {
+                    node.references.add(
+                            typeDescriptor.substring(1, typeDescriptor.length() - 1));
+                } else {
+                    assert typeDescriptor.length() > lastBrace + 3
+                    && typeDescriptor.charAt(lastBrace + 1) == 'L';
+                    node.references.add(typeDescriptor.substring(lastBrace + 2,
+                            typeDescriptor.length() - 1));
+                }
+            }
+        }
+    }
+
+    /**
+     * Graph of a single path element. Edges are indices into a local name
+     * table whose first {@link #classCount} entries are the classes defined
+     * by the element, the following ones being classes that are only
+     * referenced. This is the unit stored in the cache.
+     */
+    private static final class ElementGraph {
+        final int classCount;
+        final String[] names;
+        final int[] annotated;
+        final int[][] hierarchy;
+        final int[][] references;
+
+        ElementGraph(int classCount, String[] names, int[] annotated, int[][] hierarchy,
+                int[][] references) {
+            this.classCount = classCount;
+            this.names = names;
+            this.annotated = annotated;
+            this.hierarchy = hierarchy;
+            this.references = references;
+        }
+
+        ElementGraph(List<ClassNode> nodes) {
+            Map<String, Integer> localIds = new HashMap<String, Integer>();
+            List<String> localNames = new ArrayList<String>();
+            List<ClassNode> defined = new ArrayList<ClassNode>(nodes.size());
+            for (ClassNode node : nodes) {
+                if (!localIds.containsKey(node.name)) {
+                    localIds.put(node.name, Integer.valueOf(localNames.size()));
+                    localNames.add(node.name);
+                    defined.add(node);
+                }
+            }
+
+            classCount = defined.size();
+            annotated = Bits.makeBitSet(classCount);
+            hierarchy = new int[classCount][];
+            references = new int[classCount][];
+            for (int i = 0; i < classCount; i++) {
+                ClassNode node = defined.get(i);
+                if (node.annotated) {
+                    Bits.set(annotated, i);
+                }
+                hierarchy[i] = localize(node.hierarchy, localIds, localNames);
+                references[i] = localize(node.references, localIds, localNames);
+            }
+            names = localNames.toArray(new String[localNames.size()]);
+        }
+
+        private static int[] localize(Set<String> classNames, Map<String, Integer> localIds,
+                List<String> localNames) {
+            int[] result = new int[classNames.size()];
+            int i = 0;
+            for (String name : classNames) {
+                Integer id = localIds.get(name);
+                if (id == null) {
+                    id = Integer.valueOf(localNames.size());
+                    localIds.put(name, id);
+                    localNames.add(name);
+                }
+                result[i++] = id.intValue();
+            }
+            return result;
+        }
+
+        /**
+         * Reads a cached graph.
+         *
+         * @return {@code null-ok;} the graph, or {@code null} if the cache
+         * file is missing, stale or unreadable
+         */
+        static ElementGraph readCache(File file) {
+            if (!file.isFile()) {
+                return null;
+            }
+            try {
+                DataInputStream in = new DataInputStream(
+                        new BufferedInputStream(new FileInputStream(file)));
+                try {
+                    if (in.readInt() != CACHE_MAGIC) {
+                        return null;
+                    }
+                    int nameCount = readUleb(in);
+                    int classCount = readUleb(in);
+                    // Every name and class takes at least one byte.
+                    long length = file.length();
+                    if (nameCount < 0 || nameCount > length
+                            || classCount < 0 || classCount > nameCount) {
+                        return null;
+                    }
+                    String[] names = new String[nameCount];
+                    for (int i = 0; i < nameCount; i++) {
+                        names[i] = in.readUTF();
+                    }
+                    int[] annotated = Bits.makeBitSet(classCount);
+                    for (int i = 0; i < annotated.length; i++) {
+                        annotated[i] = in.readInt();
+                    }
+                    int[][] hierarchy = new int[classCount][];
+                    int[][] references = new int[classCount][];
+                    for (int i = 0; i < classCount; i++) {
+                        hierarchy[i] = readEdges(in, nameCount);
+                        references[i] = readEdges(in, nameCount);
+                    }
+                    return new ElementGraph(classCount, names, annotated, hierarchy,
+                            references);
+                } finally {
+                    in.close();
+                }
+            } catch (IOException e) {
+                // Treat as a cache miss, the graph will be rebuilt.
+                return null;
+            }
+        }
+
+        /**
+         * Writes this graph to the cache. The file is written under a
+         * temporary name then renamed, so that concurrent builds never see
+         * a partial file. Failures are ignored: the cache is only an
+         * optimization.
+         */
+        void writeCache(File cacheDir, File file) {
+            File tmp = null;
+            try {
+                cacheDir.mkdirs();
+                tmp = File.createTempFile(file.getName(), ".tmp", cacheDir);
+                DataOutputStream out = new DataOutputStream(
+                        new BufferedOutputStream(new FileOutputStream(tmp)));
+                try {
+                    out.writeInt(CACHE_MAGIC);
+                    writeUleb(out, names.length);
+                    writeUleb(out, classCount);
+                    for (String name : names) {
+                        out.writeUTF(name);
+                    }
+                    for (int bits : annotated) {
+                        out.writeInt(bits);
+                    }
+                    for (int i = 0; i < classCount; i++) {
+                        writeEdges(out, hierarchy[i]);
+                        writeEdges(out, references[i]);
+                    }
+                } finally {
+                    out.close();
+                }
+                if (tmp.renameTo(file)) {
+                    tmp = null;
+                }
+            } catch (IOException e) {
+                // The cache is optional, keep going.
+            } finally {
+                if (tmp != null) {
+                    tmp.delete();
+                }
+            }
+        }
+
+        private static int[] readEdges(DataInputStream in, int nameCount) throws IOException {
+            int[] edges = new int[readUleb(in)];
+            for (int i = 0; i < edges.length; i++) {
+                edges[i] = readUleb(in);
+                if (edges[i] >= nameCount) {
+                    throw new IOException("corrupt cache file");
+                }
+            }
+            return edges;
+        }
+
+        private static void writeEdges(DataOutputStream out, int[] edges) throws IOException {
+            writeUleb(out, edges.length);
+            for (int edge : edges) {
+                writeUleb(out, edge);
+            }
+        }
+
+        private static int readUleb(DataInputStream in) throws IOException {
+            int result = 0;
+            int shift = 0;
+            int b;
+            do {
+                if (shift > 28) {
+                    throw new IOException("invalid LEB128 sequence");
+                }
+                b = in.readUnsignedByte();
+                result |= (b & 0x7f) << shift;
+                shift += 7;
+            } while ((b & 0x80) != 0);
+            return result;
+        }
+
+        private static void writeUleb(DataOutputStream out, int value) throws IOException {
+            int remaining = value >>> 7;
+            while (remaining != 0) {
+                out.writeByte((value & 0x7f) | 0x80);
+                value = remaining;
+                remaining >>>= 7;
+            }
+            out.writeByte(value & 0x7f);
+        }
+    }
+}
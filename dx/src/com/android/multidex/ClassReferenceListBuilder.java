@@ -16,17 +16,8 @@
 
 package com.android.multidex;
 
-import com.android.dx.cf.direct.DirectClassFile;
-import com.android.dx.cf.iface.FieldList;
-import com.android.dx.cf.iface.MethodList;
-import com.android.dx.rop.cst.Constant;
-import com.android.dx.rop.cst.CstBaseMethodRef;
-import com.android.dx.rop.cst.CstFieldRef;
-import com.android.dx.rop.cst.CstType;
-import com.android.dx.rop.type.Prototype;
-import com.android.dx.rop.type.StdTypeList;
-import com.android.dx.rop.type.TypeList;
-import java.io.FileNotFoundException;
+import com.android.dx.util.Bits;
+import com.android.dx.util.IntList;
 import java.io.IOException;
 import java.util.Enumeration;
 import java.util.HashSet;
@@ -41,12 +32,22 @@ public class ClassReferenceListBuilder {
     private static final String CLASS_EXTENSION = ".class";
 
     private final Path path;
+    private ClassReferenceGraph graph;
     private final Set<String> classNames = new HashSet<String>();
 
     public ClassReferenceListBuilder(Path path) {
         this.path = path;
     }
 
+    /**
+     * @param path {@code non-null;} the class path
+     * @param graph {@code non-null;} prebuilt reference graph of {@code path}
+     */
+    ClassReferenceListBuilder(Path path, ClassReferenceGraph graph) {
+        this.path = path;
+        this.graph = graph;
+    }
+
     /**
      * Kept for compatibility with the gradle integration, this method just forwards to
      * {@link MainDexListBuilder#main(String[])}.
@@ -62,106 +63,72 @@ public class ClassReferenceListBuilder {
      * this is the result of running ProGuard.
      */
     public void addRoots(ZipFile jarOfRoots) throws IOException {
+        if (graph == null) {
+            graph = ClassReferenceGraph.build(path, null,
+                    Runtime.getRuntime().availableProcessors());
+        }
+        int[] kept = Bits.makeBitSet(graph.getClassCount());
+        IntList roots = new IntList();
 
         // keep roots
+        String missing = null;
         for (Enumeration<? extends ZipEntry> entries = jarOfRoots.entries();
                 entries.hasMoreElements();) {
             ZipEntry entry = entries.nextElement();
             String name = entry.getName();
             if (name.endsWith(CLASS_EXTENSION)) {
-                classNames.add(name.substring(0, name.length() - CLASS_EXTENSION.length()));
+                String className = name.substring(0, name.length() - CLASS_EXTENSION.length());
+                classNames.add(className);
+                int id = graph.getId(className);
+                if (id < 0) {
+                    if (missing == null) {
+                        missing = name;
+                    }
+                } else if (!Bits.get(kept, id)) {
+                    Bits.set(kept, id);
+                    roots.add(id);
+                }
             }
         }
+        if (missing != null) {
+            throw new IOException("Class " + missing +
+                    " is missing form original class path " + path);
+        }
 
         // keep direct references of roots (+ direct references hierarchy)
-        for (Enumeration<? extends ZipEntry> entries = jarOfRoots.entries();
-                entries.hasMoreElements();) {
-            ZipEntry entry = entries.nextElement();
-            String name = entry.getName();
-            if (name.endsWith(CLASS_EXTENSION)) {
-                DirectClassFile classFile;
-                try {
-                    classFile = path.getClass(name);
-                } catch (FileNotFoundException e) {
-                    throw new IOException("Class " + name +
-                            " is missing form original class path " + path, e);
+        int[] references = graph.getReferenceEdges();
+        int[] hierarchy = graph.getHierarchyEdges();
+        IntList work = new IntList();
+        for (int i = 0; i < roots.size(); i++) {
+            int root = roots.get(i);
+            int end = graph.getReferenceEnd(root);
+            for (int r = graph.getReferenceStart(root); r < end; r++) {
+                int ref = references[r];
+                if (Bits.get(kept, ref)) {
+                    continue;
+                }
+                Bits.set(kept, ref);
+                work.add(ref);
+                while (work.size() > 0) {
+                    int id = work.pop();
+                    int hierarchyEnd = graph.getHierarchyEnd(id);
+                    for (int h = graph.getHierarchyStart(id); h < hierarchyEnd; h++) {
+                        int parent = hierarchy[h];
+                        if (!Bits.get(kept, parent)) {
+                            Bits.set(kept, parent);
+                            work.add(parent);
+                        }
+                    }
                 }
-                addDependencies(classFile);
-            }
-        }
-    }
-
-    Set<String> getClassNames() {
-        return classNames;
-    }
-
-    private void addDependencies(DirectClassFile classFile) {
-        for (Constant constant : classFile.getConstantPool().getEntries()) {
-            if (constant instanceof CstType) {
-                checkDescriptor(((CstType) constant).getClassType().getDescriptor());
-            } else if (constant instanceof CstFieldRef) {
-                checkDescriptor(((CstFieldRef) constant).getType().getDescriptor());
-            } else if (constant instanceof CstBaseMethodRef) {
-                checkPrototype(((CstBaseMethodRef) constant).getPrototype());
             }
         }
 
-        FieldList fields = classFile.getFields();
-        int nbField = fields.size();
-        for (int i = 0; i < nbField; i++) {
-          checkDescriptor(fields.get(i).getDescriptor().getString());
-        }
-
-        MethodList methods = classFile.getMethods();
-        int nbMethods = methods.size();
-        for (int i = 0; i < nbMethods; i++) {
-          checkPrototype(Prototype.intern(methods.get(i).getDescriptor().getString()));
-        }
-    }
-
-    private void checkPrototype(Prototype proto) {
-      checkDescriptor(proto.getReturnType().getDescriptor());
-      StdTypeList args = proto.getParameterTypes();
-      for (int i = 0; i < args.size(); i++) {
-          checkDescriptor(args.get(i).getDescriptor());
-      }
-    }
-
-    private void checkDescriptor(String typeDescriptor) {
-        if (typeDescriptor.endsWith(";")) {
-            int lastBrace = typeDescriptor.lastIndexOf('[');
-            if (lastBrace < 0) {
-                addClassWithHierachy(typeDescriptor.substring(1, typeDescriptor.length()-1));
-            } else {
-                assert typeDescriptor.length() > lastBrace + 3
-                && typeDescriptor.charAt(lastBrace + 1) == 'L';
-                addClassWithHierachy(typeDescriptor.substring(lastBrace + 2,
-                        typeDescriptor.length() - 1));
-            }
+        for (int id = Bits.findFirst(kept, 0); id >= 0; id = Bits.findFirst(kept, id + 1)) {
+            classNames.add(graph.getClassName(id));
         }
     }
 
-    private void addClassWithHierachy(String classBinaryName) {
-        if (classNames.contains(classBinaryName)) {
-            return;
-        }
-
-        try {
-            DirectClassFile classFile = path.getClass(classBinaryName + CLASS_EXTENSION);
-            classNames.add(classBinaryName);
-            CstType superClass = classFile.getSuperclass();
-            if (superClass != null) {
-                addClassWithHierachy(superClass.getClassType().getClassName());
-            }
-
-            TypeList interfaceList = classFile.getInterfaces();
-            int interfaceNumber = interfaceList.size();
-            for (int i = 0; i < interfaceNumber; i++) {
-                addClassWithHierachy(interfaceList.getType(i).getClassName());
-            }
-        } catch (FileNotFoundException e) {
-            // Ignore: The referenced type is not in the path it must be part of the libraries.
-        }
+    Set<String> getClassNames() {
+        return classNames;
     }
-
 }
@@ -16,13 +16,7 @@
 
 package com.android.multidex;
 
-import com.android.dx.cf.attrib.AttRuntimeVisibleAnnotations;
-import com.android.dx.cf.direct.DirectClassFile;
-import com.android.dx.cf.iface.Attribute;
-import com.android.dx.cf.iface.FieldList;
-import com.android.dx.cf.iface.HasAttribute;
-import com.android.dx.cf.iface.MethodList;
-import java.io.FileNotFoundException;
+import java.io.File;
 import java.io.IOException;
 import java.util.HashSet;
 import java.util.Set;
@@ -65,15 +59,25 @@ public class MainDexListBuilder {
     private static final String DISABLE_ANNOTATION_RESOLUTION_WORKAROUND =
             "--disable-annotation-resolution-workaround";
 
+    /**
+     * Directory where the class reference graph of each archive of the class path is cached,
+     * keyed by the archive content hash, so that unchanged archives are not parsed again on
+     * the next run.
+     */
+    private static final String GRAPH_CACHE = "--graph-cache=";
+
     private Set<String> filesToKeep = new HashSet<String>();
 
     public static void main(String[] args) {
 
         int argIndex = 0;
         boolean keepAnnotated = true;
+        File graphCacheDir = null;
         while (argIndex < args.length -2) {
             if (args[argIndex].equals(DISABLE_ANNOTATION_RESOLUTION_WORKAROUND)) {
                 keepAnnotated = false;
+            } else if (args[argIndex].startsWith(GRAPH_CACHE)) {
+                graphCacheDir = new File(args[argIndex].substring(GRAPH_CACHE.length()));
             } else {
                 System.err.println("Invalid option " + args[argIndex]);
                 printUsage();
@@ -88,7 +92,7 @@ public class MainDexListBuilder {
 
         try {
             MainDexListBuilder builder = new MainDexListBuilder(keepAnnotated, args[argIndex],
-                    args[argIndex + 1]);
+                    args[argIndex + 1], graphCacheDir);
             Set<String> toKeep = builder.getMainDexList();
             printList(toKeep);
         } catch (IOException e) {
@@ -100,6 +104,15 @@ public class MainDexListBuilder {
 
     public MainDexListBuilder(boolean keepAnnotated, String rootJar, String pathString)
             throws IOException {
+        this(keepAnnotated, rootJar, pathString, null);
+    }
+
+    /**
+     * @param graphCacheDir {@code null-ok;} directory where the class reference graphs of the
+     * class path archives are cached, or {@code null} to disable caching
+     */
+    public MainDexListBuilder(boolean keepAnnotated, String rootJar, String pathString,
+            File graphCacheDir) throws IOException {
         ZipFile jarOfRoots = null;
         Path path = null;
         try {
@@ -111,13 +124,16 @@ public class MainDexListBuilder {
             }
             path = new Path(pathString);
 
-            ClassReferenceListBuilder mainListBuilder = new ClassReferenceListBuilder(path);
+            ClassReferenceGraph graph = ClassReferenceGraph.build(path, graphCacheDir,
+                    Runtime.getRuntime().availableProcessors());
+            ClassReferenceListBuilder mainListBuilder =
+                    new ClassReferenceListBuilder(path, graph);
             mainListBuilder.addRoots(jarOfRoots);
             for (String className : mainListBuilder.getClassNames()) {
                 filesToKeep.add(className + CLASS_EXTENSION);
             }
             if (keepAnnotated) {
-                keepAnnotated(path);
+                keepAnnotated(graph);
             }
         } finally {
             try {
@@ -157,38 +173,12 @@ public class MainDexListBuilder {
     /**
      * Keep classes annotated with runtime annotations.
      */
-    private void keepAnnotated(Path path) throws FileNotFoundException {
-        for (ClassPathElement element : path.getElements()) {
-            forClazz:
-                for (String name : element.list()) {
-                    if (name.endsWith(CLASS_EXTENSION)) {
-                        DirectClassFile clazz = path.getClass(name);
-                        if (hasRuntimeVisibleAnnotation(clazz)) {
-                            filesToKeep.add(name);
-                        } else {
-                            MethodList methods = clazz.getMethods();
-                            for (int i = 0; i<methods.size(); i++) {
-                                if (hasRuntimeVisibleAnnotation(methods.get(i))) {
-                                    filesToKeep.add(name);
-                                    continue forClazz;
-                                }
-                            }
-                            FieldList fields = clazz.getFields();
-                            for (int i = 0; i<fields.size(); i++) {
-                                if (hasRuntimeVisibleAnnotation(fields.get(i))) {
-                                    filesToKeep.add(name);
-                                    continue forClazz;
-                                }
-                            }
-                        }
-                    }
-                }
+    private void keepAnnotated(ClassReferenceGraph graph) {
+        int count = graph.getClassCount();
+        for (int id = 0; id < count; id++) {
+            if (graph.hasRuntimeVisibleAnnotation(id)) {
+                filesToKeep.add(graph.getClassName(id) + CLASS_EXTENSION);
+            }
         }
     }
-
-    private boolean hasRuntimeVisibleAnnotation(HasAttribute element) {
-        Attribute att = element.getAttributes().findFirst(
-                AttRuntimeVisibleAnnotations.ATTRIBUTE_NAME);
-        return (att != null && ((AttRuntimeVisibleAnnotations)att).getAnnotations().size()>0);
-    }
 }
@@ -16,8 +16,6 @@
 
 package com.android.multidex;
 
-import com.android.dx.cf.direct.DirectClassFile;
-import com.android.dx.cf.direct.StdAttributeFactory;
 import java.io.ByteArrayOutputStream;
 import java.io.File;
 import java.io.FileNotFoundException;
@@ -47,8 +45,6 @@ class Path {
 
     List<ClassPathElement> elements = new ArrayList<ClassPathElement>();
     private final String definition;
-    private final ByteArrayOutputStream baos = new ByteArrayOutputStream(40 * 1024);
-    private final byte[] readBuffer = new byte[20 * 1024];
 
     Path(String definition) throws IOException {
         this.definition = definition;
@@ -61,7 +57,7 @@ class Path {
         }
     }
 
-    private static byte[] readStream(InputStream in, ByteArrayOutputStream baos, byte[] readBuffer)
+    static byte[] readStream(InputStream in, ByteArrayOutputStream baos, byte[] readBuffer)
             throws IOException {
         try {
             for (;;) {
@@ -91,28 +87,4 @@ class Path {
         assert element != null;
         elements.add(element);
     }
-
-    synchronized DirectClassFile getClass(String path) throws FileNotFoundException {
-        DirectClassFile classFile = null;
-        for (ClassPathElement element : elements) {
-            try {
-                InputStream in = element.open(path);
-                try {
-                    byte[] bytes = readStream(in, baos, readBuffer);
-                    baos.reset();
-                    classFile = new DirectClassFile(bytes, path, false);
-                    classFile.setAttributeFactory(StdAttributeFactory.THE_ONE);
-                    break;
-                } finally {
-                    in.close();
-                }
-            } catch (IOException e) {
-                // search next element
-            }
-        }
-        if (classFile == null) {
-            throw new FileNotFoundException("File \"" + path + "\" not found");
-        }
-        return classFile;
-    }
 }
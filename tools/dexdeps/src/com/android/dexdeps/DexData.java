@@ -149,15 +149,133 @@ public class DexData {
         readByteBuffer(Integer.BYTES * count).asIntBuffer().get(stringOffsets);
 
         mStrings = new String[count];
+        if (count == 0) {
+            return;
+        }
 
-        seek(stringOffsets[0]);
+        /*
+         * Read all of the string data with a single read, then decode it in
+         * place with one scratch buffer. The read ends after the string
+         * with the highest offset, at most 3 bytes per char past its length.
+         */
+        int start = Integer.MAX_VALUE;
+        int last = 0;
+        for (int offset : stringOffsets) {
+            start = Math.min(start, offset);
+            last = Math.max(last, offset);
+        }
+        if (start < 0 || last >= mDexFile.length()) {
+            System.err.println("String data offset out of range");
+            throw new DexDataException();
+        }
+        seek(last);
+        int lastLength = readUnsignedLeb128();
+        if (lastLength < 0) {
+            System.err.println("Bad string data at offset " + last);
+            throw new DexDataException();
+        }
+        long end = Math.min(mDexFile.getFilePointer() + lastLength * 3L + 1,
+                mDexFile.length());
+        byte[] stringData = new byte[(int) (end - start)];
+        seek(start);
+        readBytes(stringData);
+
+        char[] chars = new char[64];
         for (int i = 0; i < count; i++) {
-            seek(stringOffsets[i]);         // should be a no-op
-            mStrings[i] = readString();
+            try {
+                int pos = stringOffsets[i] - start;
+                int utf16len = 0;
+                int shift = 0;
+                int b;
+                do {
+                    if (shift == 35) {
+                        throw new DexDataException();
+                    }
+                    b = byteAt(stringData, pos++);
+                    utf16len |= (b & 0x7f) << shift;
+                    shift += 7;
+                } while ((b & 0x80) != 0);
+
+                // every char takes at least one byte
+                if (utf16len < 0 || utf16len > stringData.length - pos) {
+                    throw new DexDataException();
+                }
+                if (chars.length < utf16len) {
+                    chars = new char[Math.max(utf16len, chars.length * 2)];
+                }
+                mStrings[i] = decodeString(stringData, pos, chars, utf16len);
+            } catch (DexDataException e) {
+                System.err.println("Bad string data for string " + i);
+                throw e;
+            }
             //System.out.println("STR: " + i + ": " + mStrings[i]);
         }
     }
 
+    /**
+     * Decodes the zero-terminated modified UTF-8 string at {@code pos},
+     * which the dex file declares to hold {@code utf16len} chars.
+     *
+     * @throws DexDataException if the string is malformed or doesn't hold
+     * {@code utf16len} chars
+     */
+    private static String decodeString(byte[] bytes, int pos, char[] chars, int utf16len)
+            throws DexDataException {
+        int length = 0;
+        while (true) {
+            int a = byteAt(bytes, pos++);
+            if (a == 0) {
+                break;
+            }
+            if (length == utf16len) {
+                throw new DexDataException();
+            }
+            if (a < 0x80) {
+                chars[length++] = (char) a;
+            } else if ((a & 0xe0) == 0xc0) {
+                int b1 = continuationAt(bytes, pos++);
+                chars[length++] = (char) (((a & 0x1f) << 6) | b1);
+            } else if ((a & 0xf0) == 0xe0) {
+                int b1 = continuationAt(bytes, pos++);
+                int b2 = continuationAt(bytes, pos++);
+                chars[length++] = (char) (((a & 0x0f) << 12) | (b1 << 6) | b2);
+            } else {
+                throw new DexDataException();
+            }
+        }
+        if (length != utf16len) {
+            throw new DexDataException();
+        }
+        return new String(chars, 0, length);
+    }
+
+    /**
+     * Returns the unsigned byte at {@code pos}.
+     *
+     * @throws DexDataException if {@code pos} is past the end of {@code bytes}
+     */
+    private static int byteAt(byte[] bytes, int pos) throws DexDataException {
+        if (pos >= bytes.length) {
+            throw new DexDataException();
+        }
+        return bytes[pos] & 0xff;
+    }
+
+    /**
+     * Returns the payload bits of the modified UTF-8 continuation byte at
+     * {@code pos}.
+     *
+     * @throws DexDataException if there is no such byte or it isn't of
+     * the form {@code 10xxxxxx}
+     */
+    private static int continuationAt(byte[] bytes, int pos) throws DexDataException {
+        int b = byteAt(bytes, pos);
+        if ((b & 0xc0) != 0x80) {
+            throw new DexDataException();
+        }
+        return b & 0x3f;
+    }
+
     /**
      * Loads the type ID list.
      */
@@ -474,18 +592,23 @@ public class DexData {
     }
 
     /**
-     * Reads a variable-length unsigned LEB128 value.  Does not attempt to
-     * verify that the value is valid.
+     * Reads a variable-length unsigned LEB128 value.
      *
      * @throws EOFException if we run off the end of the file
+     * @throws DexDataException if the value takes more than five bytes
      */
     int readUnsignedLeb128() throws IOException {
         int result = 0;
+        int shift = 0;
         byte val;
 
         do {
+            if (shift == 35) {
+                throw new DexDataException();
+            }
             val = readByte();
-            result = (result << 7) | (val & 0x7f);
+            result |= (val & 0x7f) << shift;
+            shift += 7;
         } while (val < 0);
 
         return result;
@@ -501,29 +624,6 @@ public class DexData {
         return ByteBuffer.wrap(bytes).order(mByteOrder);
     }
 
-    /**
-     * Reads a UTF-8 string.
-     *
-     * We don't know how long the UTF-8 string is, so we try to read the worst case amount of bytes.
-     *
-     * Note that the dex file pointer will likely be at a wrong location after this operation, which
-     * means it can't be used in the middle of sequential reads.
-     */
-    String readString() throws IOException {
-        int utf16len = readUnsignedLeb128();
-        byte inBuf[] = new byte[utf16len * 3];      // worst case
-
-        int bytesRead = mDexFile.read(inBuf);
-        for (int i = 0; i < bytesRead; i++) {
-            if (inBuf[i] == 0) {
-                bytesRead = i;
-                break;
-            }
-        }
-
-        return new String(inBuf, 0, bytesRead, "UTF-8");
-    }
-
     /*
      * =======================================================================
      *      Internal "structure" declarations